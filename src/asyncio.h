@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+
+// Streams a byte range from one descriptor to another with several blocks in flight. Built with
+// HAVE_LIBURING it keeps the reads and writes of all blocks queued on an io_uring with registered
+// buffers; without it, or where the kernel refuses a ring, a writer thread drains filled blocks
+// while the caller reads the next ones.
+class AsyncIoQueue {
+public:
+    // Rewrites a block in place once it is read and returns the bytes to write, 0 to write nothing
+    // or -1 to fail. Setting stop issues no reads past this block, but blocks already read may still
+    // be written. Blocks can finish out of order, index says which one it is.
+    using Transform = std::function<ssize_t(char* block, size_t length, uint64_t index, bool& stop)>;
+
+    // Called with the size of every finished write
+    using Progress = std::function<void(size_t bytes)>;
+
+    struct Stream {
+        int in = -1;
+        uint64_t inOffset = 0;
+        uint64_t length = 0;
+        int out = -1;
+        uint64_t outOffset = 0;
+        size_t outStride = 0;   // output bytes per input block, 0 when blocks keep their size
+        size_t readAlignment = 0;   // O_DIRECT sources read whole aligned blocks, the part past EOF comes back short
+    };
+
+    AsyncIoQueue(size_t depth, size_t blockSize, size_t alignment = 4096);
+    ~AsyncIoQueue();
+
+    AsyncIoQueue(const AsyncIoQueue&) = delete;
+    AsyncIoQueue& operator=(const AsyncIoQueue&) = delete;
+
+    // False when the buffers could not be allocated, or once a broken ring left them with the kernel
+    bool valid() const { return !buffers.empty() && !retired; }
+
+    size_t blockSize() const { return bufferSize; }
+
+    // Function to move the whole stream, false on an I/O error, a failed transform or cancellation
+    bool run(const Stream& stream, const Transform& transform = nullptr, const Progress& progress = nullptr);
+
+private:
+    struct Ring;
+
+    std::vector<char*> buffers;
+    size_t bufferSize;
+    std::unique_ptr<Ring> ring;
+    bool retired = false;   // requests may still target the buffers, they are leaked instead of freed
+
+    size_t alignedReadLength(size_t want, size_t alignment) const;
+    bool runRing(const Stream& stream, const Transform& transform, const Progress& progress);
+    bool runThreaded(const Stream& stream, const Transform& transform, const Progress& progress);
+};
+
+#endif // ASYNC_IO_H
@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#ifndef CACHE_H
+#define CACHE_H
+
+
+// On-disk layout of the binary ISO cache:
+//
+//   IsoCacheHeader
+//   IsoCacheRecord records[entryCount] per-entry stat data and the location of its path
+//   char           blob[blobSize]      all paths back to back, no separators
+//
+// The file is mmapped as a whole and entries are served as string_views into the blob,
+// so loading the cache does not allocate per entry.
+
+constexpr char ISO_CACHE_MAGIC[8] = {'I', 'S', 'O', 'C', 'M', 'D', 'C', '\0'};
+constexpr uint32_t ISO_CACHE_VERSION = 2;
+
+struct IsoCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t entryCount;
+    uint64_t blobSize;
+    int64_t validatedAt;    // ns timestamp of the last full existence check, 0 if never validated
+};
+
+// Metadata captured by stat during traverse, ino == 0 marks an entry without metadata
+struct IsoCacheRecord {
+    uint64_t pathOffset;
+    uint32_t pathLength;
+    uint32_t reserved;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t ino;
+    uint64_t dev;
+};
+
+// In-memory ISO cache entry as produced by traverse
+struct IsoCacheEntry {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t ino = 0;
+    uint64_t dev = 0;
+};
+
+// Function to convert stat timestamps to the ns resolution stored in the cache
+inline int64_t statTimeToNs(const struct timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+
+// Read-only memory mapped view of the binary ISO cache
+class IsoCacheView {
+private:
+    char* mapped = nullptr;
+    size_t mappedSize = 0;
+    const IsoCacheRecord* records = nullptr;
+    const char* blob = nullptr;
+    size_t count = 0;
+    int64_t validated = 0;
+
+public:
+    IsoCacheView() = default;
+    IsoCacheView(const IsoCacheView&) = delete;
+    IsoCacheView& operator=(const IsoCacheView&) = delete;
+
+    ~IsoCacheView() {
+        reset();
+    }
+
+    // Map the cache file and validate its header, returns false for missing or malformed files
+    bool open(const std::string& path) {
+        reset();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+
+        // Acquire a shared lock while mapping
+        if (flock(fd, LOCK_SH) == -1) {
+            close(fd);
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(IsoCacheHeader)) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            return false;
+        }
+
+        size_t fileSize = static_cast<size_t>(st.st_size);
+        void* addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        flock(fd, LOCK_UN);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+
+        mapped = static_cast<char*>(addr);
+        mappedSize = fileSize;
+
+        IsoCacheHeader header;
+        std::memcpy(&header, mapped, sizeof(header));
+        if (std::memcmp(header.magic, ISO_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != ISO_CACHE_VERSION || header.headerSize != sizeof(IsoCacheHeader)) {
+            reset();
+            return false;
+        }
+
+        // Make sure the record table and the blob fit inside the file
+        const uint64_t maxEntries = (fileSize - sizeof(IsoCacheHeader)) / sizeof(IsoCacheRecord);
+        if (header.entryCount > maxEntries) {
+            reset();
+            return false;
+        }
+        const size_t tableSize = header.entryCount * sizeof(IsoCacheRecord);
+        if (header.blobSize != fileSize - sizeof(IsoCacheHeader) - tableSize) {
+            reset();
+            return false;
+        }
+
+        records = reinterpret_cast<const IsoCacheRecord*>(mapped + sizeof(IsoCacheHeader));
+        blob = mapped + sizeof(IsoCacheHeader) + tableSize;
+        count = header.entryCount;
+        validated = header.validatedAt;
+
+        // Every path has to lie inside the blob
+        for (size_t i = 0; i < count; ++i) {
+            if (records[i].pathOffset > header.blobSize ||
+                records[i].pathLength > header.blobSize - records[i].pathOffset) {
+                reset();
+                return false;
+            }
+        }
+
+        madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    // Unmap the cache file
+    void reset() {
+        if (mapped) {
+            munmap(mapped, mappedSize);
+        }
+        mapped = nullptr;
+        mappedSize = 0;
+        records = nullptr;
+        blob = nullptr;
+        count = 0;
+        validated = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    int64_t validatedAt() const {
+        return validated;
+    }
+
+    std::string_view operator[](size_t index) const {
+        return std::string_view(blob + records[index].pathOffset, records[index].pathLength);
+    }
+
+    const IsoCacheRecord& record(size_t index) const {
+        return records[index];
+    }
+};
+
+
+// On-disk layout of the directory snapshot table kept next to the ISO cache:
+//
+//   DirSnapshotHeader
+//   DirSnapshotRecord records[entryCount]
+//   char              blob[blobSize]      directory paths followed by their '\0' terminated subdirectory
+//                                         names and image file names, each image name led by its
+//                                         ImageFileType byte
+//
+// A directory whose mtime, ctime, inode and device still match its snapshot has the same
+// entries as when it was last read, so a rescan can reuse the stored names instead of reading
+// it again. Rewriting a file in place leaves the directory untouched, so the ISOs it lists are
+// still stat'ed on every rescan.
+
+constexpr char DIR_SNAPSHOT_MAGIC[8] = {'I', 'S', 'O', 'C', 'M', 'D', 'D', '\0'};
+constexpr uint32_t DIR_SNAPSHOT_VERSION = 3;
+
+struct DirSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t entryCount;
+    uint64_t blobSize;
+};
+
+struct DirSnapshotRecord {
+    uint64_t pathOffset;
+    uint32_t pathLength;
+    uint32_t subdirCount;
+    uint64_t subdirsOffset;
+    uint64_t subdirsLength;
+    int64_t mtime;
+    int64_t ctime;
+    uint64_t ino;
+    uint64_t dev;
+    uint64_t fileCount;
+    uint64_t imagesOffset;
+    uint64_t imagesLength;
+    uint32_t imageCount;
+    uint32_t reserved;
+};
+
+// ISO or conversion candidate met while reading a directory
+struct DirSnapshotImage {
+    uint8_t type;       // ImageFileType
+    std::string name;
+};
+
+// Directory state as seen the last time it was read
+struct DirSnapshot {
+    std::string path;
+    int64_t mtime = 0;
+    int64_t ctime = 0;
+    uint64_t ino = 0;
+    uint64_t dev = 0;
+    uint64_t fileCount = 0;
+    std::vector<std::string> subdirs;
+    std::vector<DirSnapshotImage> images;
+
+    // Check whether a fresh stat of the directory still matches this snapshot
+    bool matches(const struct stat& st) const {
+        return mtime == statTimeToNs(st.st_mtim) && ctime == statTimeToNs(st.st_ctim) &&
+               ino == static_cast<uint64_t>(st.st_ino) && dev == static_cast<uint64_t>(st.st_dev);
+    }
+};
+
+// Snapshots loaded before a scan and the ones collected by traverse during it
+struct DirSnapshotScan {
+    std::unordered_map<std::string, DirSnapshot> previous;
+    std::vector<DirSnapshot> current;
+    std::mutex currentMutex;
+};
+
+
+// On-disk layout of the trigram index kept next to the ISO cache once it grows large:
+//
+//   TrigramIndexHeader
+//   TrigramBucket buckets[TRIGRAM_BUCKETS]   one posting list per trigram hash bucket
+//   uint8_t       postings[postingsSize]     cache entry numbers, ascending, as LEB128 deltas
+//
+// Trigrams of the lowercased paths are hashed into a fixed number of buckets, so a posting
+// list may name entries that merely share a bucket and every survivor is checked against its
+// path. The header names the cache file the index was built from, any other file makes it stale.
+
+constexpr char TRIGRAM_INDEX_MAGIC[8] = {'I', 'S', 'O', 'C', 'M', 'D', 'T', '\0'};
+constexpr uint32_t TRIGRAM_INDEX_VERSION = 1;
+constexpr uint32_t TRIGRAM_BUCKETS = 1u << 16;
+
+struct TrigramIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t cacheIno;      // identity of the cache file the postings refer to
+    uint64_t cacheSize;
+    int64_t cacheMtime;
+    uint64_t entryCount;
+    uint64_t postingsSize;
+};
+
+struct TrigramBucket {
+    uint64_t offset;
+    uint32_t length;        // bytes
+    uint32_t count;         // entries
+    uint32_t lastEntry;     // base for appending further deltas
+    uint32_t reserved;
+};
+
+// Function to hash three lowercased path bytes into their bucket
+inline uint32_t trigramBucket(unsigned char a, unsigned char b, unsigned char c) {
+    uint32_t key = (uint32_t(a) << 16) | (uint32_t(b) << 8) | uint32_t(c);
+    return (key * 2654435761u) >> 16;
+}
+
+// Function to collect the distinct buckets of a lowercased text
+inline void trigramBucketsOf(std::string_view folded, std::vector<uint32_t>& buckets) {
+    buckets.clear();
+    for (size_t i = 0; i + 3 <= folded.size(); ++i) {
+        buckets.push_back(trigramBucket(folded[i], folded[i + 1], folded[i + 2]));
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+}
+
+
+// Read-only memory mapped view of the trigram index
+class TrigramIndexView {
+private:
+    char* mapped = nullptr;
+    size_t mappedSize = 0;
+    TrigramIndexHeader header{};
+    const TrigramBucket* buckets = nullptr;
+    const uint8_t* postings = nullptr;
+
+public:
+    TrigramIndexView() = default;
+    TrigramIndexView(const TrigramIndexView&) = delete;
+    TrigramIndexView& operator=(const TrigramIndexView&) = delete;
+
+    ~TrigramIndexView() {
+        reset();
+    }
+
+    // Map the index and validate it, returns false unless it was built from the cache file described by cacheStat
+    bool open(const std::string& path, const struct stat& cacheStat) {
+        reset();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+
+        struct stat st;
+        const size_t tableSize = TRIGRAM_BUCKETS * sizeof(TrigramBucket);
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(TrigramIndexHeader) + tableSize) {
+            close(fd);
+            return false;
+        }
+
+        size_t fileSize = static_cast<size_t>(st.st_size);
+        void* addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+
+        mapped = static_cast<char*>(addr);
+        mappedSize = fileSize;
+
+        std::memcpy(&header, mapped, sizeof(header));
+        if (std::memcmp(header.magic, TRIGRAM_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != TRIGRAM_INDEX_VERSION || header.headerSize != sizeof(TrigramIndexHeader) ||
+            header.postingsSize != fileSize - sizeof(TrigramIndexHeader) - tableSize ||
+            header.cacheIno != static_cast<uint64_t>(cacheStat.st_ino) ||
+            header.cacheSize != static_cast<uint64_t>(cacheStat.st_size) ||
+            header.cacheMtime != statTimeToNs(cacheStat.st_mtim)) {
+            reset();
+            return false;
+        }
+
+        buckets = reinterpret_cast<const TrigramBucket*>(mapped + sizeof(TrigramIndexHeader));
+        postings = reinterpret_cast<const uint8_t*>(mapped + sizeof(TrigramIndexHeader) + tableSize);
+
+        // Every posting list has to lie inside the postings area
+        for (uint32_t i = 0; i < TRIGRAM_BUCKETS; ++i) {
+            if (buckets[i].offset > header.postingsSize || buckets[i].length > header.postingsSize - buckets[i].offset) {
+                reset();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Unmap the index
+    void reset() {
+        if (mapped) {
+            munmap(mapped, mappedSize);
+        }
+        mapped = nullptr;
+        mappedSize = 0;
+        header = TrigramIndexHeader{};
+        buckets = nullptr;
+        postings = nullptr;
+    }
+
+    uint64_t entryCount() const {
+        return header.entryCount;
+    }
+
+    const TrigramBucket& bucket(uint32_t index) const {
+        return buckets[index];
+    }
+
+    std::string_view postingBytes(uint32_t index) const {
+        return std::string_view(reinterpret_cast<const char*>(postings + buckets[index].offset), buckets[index].length);
+    }
+
+    // Function to decode the entry numbers of a bucket in ascending order
+    void decode(uint32_t index, std::vector<uint32_t>& entries) const {
+        entries.clear();
+        entries.reserve(buckets[index].count);
+        const uint8_t* in = postings + buckets[index].offset;
+        const uint8_t* end = in + buckets[index].length;
+        uint32_t entry = 0;
+        while (in < end) {
+            uint32_t delta = 0;
+            for (int shift = 0; in < end && shift < 35; shift += 7) {
+                uint8_t byte = *in++;
+                delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            entry += delta;
+            entries.push_back(entry);
+        }
+    }
+};
+
+#endif // CACHE_H
@@ -0,0 +1,366 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// How the terms of a filter query are matched, chosen by the first character of the query
+enum class FilterMode {
+    Substring,  // term1;term2
+    Fuzzy,      // ~term, characters in order with gaps allowed, ranked by score
+    Glob        // =pattern, shell glob over the basename or, with a '/', the whole path
+};
+
+
+// Case-insensitive multi-token matcher for filterFiles, the query is split on ';' and compiled
+// once so matching a file name neither allocates nor copies it. A name matches when any term does
+class FilterMatcher {
+public:
+    explicit FilterMatcher(const std::string& query) {
+        std::string terms = query;
+        if (!terms.empty() && (terms[0] == '~' || terms[0] == '=')) {
+            mode = terms[0] == '~' ? FilterMode::Fuzzy : FilterMode::Glob;
+            terms.erase(0, 1);
+        }
+
+        std::stringstream ss(terms);
+        std::string token;
+
+        while (std::getline(ss, token, ';')) {
+            // Empty tokens never matched anything, so they are dropped here
+            if (token.empty()) continue;
+            if (mode == FilterMode::Glob) {
+                globs.push_back(compileGlob(token));
+            }
+            for (char& c : token) c = foldAscii(c);
+            if (std::find(tokens.begin(), tokens.end(), token) == tokens.end()) {
+                tokens.push_back(std::move(token));
+            }
+        }
+    }
+
+    bool empty() const { return tokens.empty(); }
+
+    FilterMode filterMode() const { return mode; }
+
+    // Fuzzy results are ordered by score instead of by list position
+    bool ranked() const { return mode == FilterMode::Fuzzy; }
+
+    // Folded terms, for Glob these are the patterns as typed
+    const std::vector<std::string>& tokenList() const { return tokens; }
+
+    // Function to check whether any token occurs in text, ANSI color codes are ignored
+    bool matches(std::string_view text) const {
+        if (std::memchr(text.data(), '\033', text.size()) != nullptr) {
+            // Colored entries are rare, strip them into a buffer reused by this thread
+            thread_local std::string plain;
+            stripAnsiCodes(text, plain);
+            text = plain;
+        }
+
+        return matchesPlain(text);
+    }
+
+    // Function to check text that is known to carry no color codes
+    bool matchesPlain(std::string_view text) const {
+        switch (mode) {
+            case FilterMode::Fuzzy:
+                for (const std::string& token : tokens) {
+                    if (fuzzyScore(text, token) >= 0) return true;
+                }
+                return false;
+            case FilterMode::Glob:
+                for (const GlobPattern& glob : globs) {
+                    if (globMatch(text, glob)) return true;
+                }
+                return false;
+            default:
+                for (const std::string& token : tokens) {
+                    if (contains(text.data(), text.size(), token)) return true;
+                }
+                return false;
+        }
+    }
+
+    // Function to rate a fuzzy match, higher is better and -1 means no term matches
+    int score(std::string_view text) const {
+        if (std::memchr(text.data(), '\033', text.size()) != nullptr) {
+            thread_local std::string plain;
+            stripAnsiCodes(text, plain);
+            text = plain;
+        }
+
+        int best = -1;
+        for (const std::string& token : tokens) {
+            best = std::max(best, fuzzyScore(text, token));
+        }
+        return best;
+    }
+
+private:
+    // A glob split at its stars, every segment position is the set of bytes it accepts
+    struct GlobPattern {
+        std::vector<std::vector<std::bitset<256>>> segments;
+        bool anchoredStart = true;
+        bool anchoredEnd = true;
+        bool wholePath = false;
+    };
+
+    FilterMode mode = FilterMode::Substring;
+    std::vector<std::string> tokens;
+    std::vector<GlobPattern> globs;
+
+    // Function to find the ']' closing the class opened at pattern[open], a ']' right after
+    // the opening bracket (or its negation) is a member and not the end
+    static size_t globClassEnd(const std::string& pattern, size_t open) {
+        size_t first = open + 1;
+        if (first < pattern.size() && (pattern[first] == '!' || pattern[first] == '^')) ++first;
+        return first < pattern.size() ? pattern.find(']', first + 1) : std::string::npos;
+    }
+
+    // Function to compile one glob, '*', '?', '[a-z]', '[!a-z]' and '\' escapes are understood
+    static GlobPattern compileGlob(const std::string& pattern) {
+        GlobPattern glob;
+        glob.wholePath = pattern.find('/') != std::string::npos;
+        glob.anchoredStart = pattern.front() != '*';
+        glob.segments.emplace_back();
+
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            std::bitset<256> accepted;
+            char c = pattern[i];
+
+            if (c == '*') {
+                if (!glob.segments.back().empty()) glob.segments.emplace_back();
+                continue;
+            } else if (c == '?') {
+                accepted.set();
+            } else if (c == '[' && globClassEnd(pattern, i) != std::string::npos) {
+                size_t close = globClassEnd(pattern, i);
+                size_t j = i + 1;
+                bool negate = pattern[j] == '!' || pattern[j] == '^';
+                if (negate) ++j;
+
+                for (; j < close; ++j) {
+                    unsigned char low = static_cast<unsigned char>(pattern[j]);
+                    unsigned char high = low;
+                    if (j + 2 < close && pattern[j + 1] == '-') {
+                        high = static_cast<unsigned char>(pattern[j + 2]);
+                        j += 2;
+                    }
+                    for (unsigned v = low; v <= high; ++v) accepted.set(v);
+                }
+                i = close;
+
+                for (unsigned v = 'a'; v <= 'z'; ++v) {
+                    if (accepted[v] || accepted[v - 0x20]) {
+                        accepted.set(v);
+                        accepted.set(v - 0x20);
+                    }
+                }
+                if (negate) accepted.flip();
+            } else {
+                if (c == '\\' && i + 1 < pattern.size()) c = pattern[++i];
+                unsigned char folded = static_cast<unsigned char>(foldAscii(c));
+                accepted.set(folded);
+                if (isLower(static_cast<char>(folded))) accepted.set(folded - 0x20);
+            }
+            glob.segments.back().push_back(accepted);
+        }
+
+        glob.anchoredEnd = pattern.back() != '*' || (pattern.size() > 1 && pattern[pattern.size() - 2] == '\\');
+        if (glob.segments.back().empty()) glob.segments.pop_back();
+        return glob;
+    }
+
+    static bool segmentMatchesAt(std::string_view text, size_t at, const std::vector<std::bitset<256>>& segment) {
+        for (size_t i = 0; i < segment.size(); ++i) {
+            if (!segment[i][static_cast<unsigned char>(text[at + i])]) return false;
+        }
+        return true;
+    }
+
+    // Function to match a compiled glob, each star takes the leftmost fit of the next segment,
+    // which is enough for patterns whose only repetition is the star
+    static bool globMatch(std::string_view text, const GlobPattern& glob) {
+        if (!glob.wholePath) {
+            size_t slash = text.rfind('/');
+            if (slash != std::string_view::npos) text.remove_prefix(slash + 1);
+        }
+
+        const auto& segments = glob.segments;
+        if (segments.empty()) return !glob.anchoredStart || text.empty();
+
+        // Without any star the single segment has to cover the whole text
+        if (segments.size() == 1 && glob.anchoredStart && glob.anchoredEnd) {
+            return text.size() == segments[0].size() && segmentMatchesAt(text, 0, segments[0]);
+        }
+
+        size_t first = 0;
+        size_t last = segments.size();
+        size_t pos = 0;
+        size_t limit = text.size();
+
+        if (glob.anchoredStart) {
+            if (segments[0].size() > text.size() || !segmentMatchesAt(text, 0, segments[0])) return false;
+            pos = segments[0].size();
+            first = 1;
+        }
+        if (glob.anchoredEnd && last > first) {
+            const auto& tail = segments[last - 1];
+            if (tail.size() > text.size() - pos || !segmentMatchesAt(text, text.size() - tail.size(), tail)) return false;
+            limit = text.size() - tail.size();
+            --last;
+        }
+
+        for (size_t k = first; k < last; ++k) {
+            const auto& segment = segments[k];
+            bool found = false;
+            for (; pos + segment.size() <= limit; ++pos) {
+                if (segmentMatchesAt(text, pos, segment)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) return false;
+            pos += segment.size();
+        }
+        return true;
+    }
+
+    // Function to weigh a match at text[i], starts of words count more than their middles
+    static int boundaryBonus(std::string_view text, size_t i) {
+        if (i == 0) return 8;
+        const unsigned char prev = static_cast<unsigned char>(text[i - 1]);
+        const unsigned char cur = static_cast<unsigned char>(text[i]);
+        if (!std::isalnum(prev)) return 8;
+        if (std::islower(prev) && std::isupper(cur)) return 7;
+        if (!std::isdigit(prev) && std::isdigit(cur)) return 7;
+        return 0;
+    }
+
+    // Function to score a fuzzy term the way fzf's v1 matcher does: the first in-order
+    // occurrence is found forward, shrunk backward to its shortest window and then weighed,
+    // -1 if the term does not occur in order
+    static int fuzzyScore(std::string_view text, const std::string& pattern) {
+        size_t p = 0;
+        size_t end = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (foldAscii(text[i]) == pattern[p] && ++p == pattern.size()) {
+                end = i + 1;
+                break;
+            }
+        }
+        if (p < pattern.size()) return -1;
+
+        size_t start = end;
+        while (p > 0) {
+            --start;
+            if (foldAscii(text[start]) == pattern[p - 1]) --p;
+        }
+
+        const int scoreMatch = 16, gapStart = -3, gapExtension = -1, consecutiveBonus = 4;
+        int score = 0;
+        bool inGap = false;
+        bool previousMatched = false;
+        for (size_t i = start; i < end; ++i) {
+            if (p < pattern.size() && foldAscii(text[i]) == pattern[p]) {
+                int bonus = boundaryBonus(text, i);
+                if (p == 0) bonus *= 2;
+                score += scoreMatch + bonus + (previousMatched ? consecutiveBonus : 0);
+                previousMatched = true;
+                inGap = false;
+                ++p;
+            } else {
+                score += inGap ? gapExtension : gapStart;
+                previousMatched = false;
+                inGap = true;
+            }
+        }
+        return std::max(score, 0);
+    }
+
+    static char foldAscii(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+    }
+
+    static bool isLower(char c) {
+        return c >= 'a' && c <= 'z';
+    }
+
+    // Function to compare count bytes of text against an already folded token
+    static bool equalsFolded(const char* text, const char* token, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (foldAscii(text[i]) != token[i]) return false;
+        }
+        return true;
+    }
+
+    // Function to drop ANSI escape sequences the same way removeAnsiCodes does
+    static void stripAnsiCodes(std::string_view input, std::string& out) {
+        out.clear();
+        for (size_t i = 0; i < input.size(); ++i) {
+            if (input[i] == '\033' && i + 1 < input.size() && input[i + 1] == '[') {
+                while (i < input.size() && !std::isalpha(static_cast<unsigned char>(input[i]))) ++i;
+            } else {
+                out += input[i];
+            }
+        }
+    }
+
+    // Function to find a folded token in text, 16 candidate positions at a time are kept only
+    // if both the first and the last token byte match and then verified in between
+    static bool contains(const char* text, size_t length, const std::string& token) {
+        const size_t n = token.size();
+        if (n > length) return false;
+
+        const char first = token.front();
+        const char last = token.back();
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        // Or-ing 0x20 folds a letter onto its lowercase form, other bytes must match exactly
+        const __m128i firstBytes = _mm_set1_epi8(first);
+        const __m128i lastBytes = _mm_set1_epi8(last);
+        const __m128i firstFold = _mm_set1_epi8(isLower(first) ? 0x20 : 0);
+        const __m128i lastFold = _mm_set1_epi8(isLower(last) ? 0x20 : 0);
+
+        auto scanBlock = [&](size_t at) {
+            const __m128i blockFirst = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + at)), firstFold);
+            const __m128i blockLast = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + at + n - 1)), lastFold);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(blockFirst, firstBytes), _mm_cmpeq_epi8(blockLast, lastBytes))));
+
+            while (mask != 0) {
+                const size_t candidate = at + static_cast<size_t>(__builtin_ctz(mask));
+                if (n <= 2 || equalsFolded(text + candidate + 1, token.data() + 1, n - 2)) return true;
+                mask &= mask - 1;
+            }
+            return false;
+        };
+
+        if (length >= n - 1 + 16) {
+            const size_t lastBlock = length - (n - 1) - 16;
+            for (; i < lastBlock; i += 16) {
+                if (scanBlock(i)) return true;
+            }
+            // The final block overlaps the previous one instead of falling back to bytes
+            return scanBlock(lastBlock);
+        }
+#endif
+
+        // Short texts, or every text without SSE2
+        for (; i + n <= length; ++i) {
+            if (foldAscii(text[i]) == first && foldAscii(text[i + n - 1]) == last &&
+                equalsFolded(text + i + 1, token.data() + 1, n > 2 ? n - 2 : 0)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // FILTER_H
@@ -5,11 +5,15 @@
 
 #include <algorithm>
 #include <atomic>
+#include <bitset>
 #include <cctype>
 #include <chrono>
+#include <climits>
 #include <condition_variable>
 #include <csignal>
+#include <cstddef>
 #include <cstring>
+#include <deque>
 #include <dirent.h>
 #include <fcntl.h>
 #include <filesystem>
@@ -19,10 +23,15 @@
 #include <grp.h>
 #include <iostream>
 #include <libmount/libmount.h>
+#include <linux/fs.h>
+#include <linux/futex.h>
+#include <list>
 #include <map>
 #include <memory>
 #include <mntent.h>
 #include <mutex>
+#include <poll.h>
+#include <optional>
 #include <pwd.h>
 #include <queue>
 #include <random>
@@ -31,14 +40,22 @@
 #include <set>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <sys/fanotify.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #include <sys/statvfs.h>
 #include <termios.h>
 #include <thread>
 #include <vector>
 #include <unistd.h>
+#include <unordered_map>
 #include <unordered_set>
 
 
@@ -57,6 +74,11 @@ extern std::mutex couNtMutex;
 // For storing isoFiles in RAM cache
 extern std::vector<std::string> globalIsoFileList; 
 
+// Lowercase shadow of globalIsoFileList and filtered views of it, defined in isolist.h
+class IsoListIndex;
+struct IsoListView;
+extern IsoListIndex globalIsoListIndex;
+
 // Cache for directory and filename transformations
 extern std::unordered_map<std::string, std::string> transformationCache;
 
@@ -134,7 +156,7 @@ void helpSearches(bool isCpMv, bool import2ISO);
 void helpMappings();
 void clearHistory(const std::string& inputSearch);
 void setDisplayMode(const std::string& inputSearch);
-void refreshListAfterAutoUpdate(int timeoutSeconds, std::atomic<bool>& isAtISOList, std::atomic<bool>& isImportRunning, std::atomic<bool>& updateHasRun, std::vector<std::string>& filteredFiles, std::vector<std::string>& sourceList, bool& isFiltered, std::string& listSubtype, std::atomic<bool>& newISOFound);
+void refreshListAfterAutoUpdate(std::atomic<bool>& isAtISOList, std::atomic<bool>& isImportRunning, std::atomic<bool>& stopRefresh, std::vector<std::string>& filteredFiles, std::vector<std::string>& sourceList, bool& isFiltered, std::string& listSubtype, std::atomic<bool>& newISOFound);
 void selectForIsoFiles(const std::string& operation, bool& historyPattern, int& maxDepth, bool& verbose, std::atomic<bool>& updateHasRun, std::atomic<bool>& isAtISOList, std::atomic<bool>& isImportRunning, std::atomic<bool>& newISOFound);
 void printList(const std::vector<std::string>& items, const std::string& listType, const std::string& listSubType);
 void verbosePrint(const std::set<std::string>& primarySet, const std::set<std::string>& secondarySet , const std::set<std::string>& tertiarySet, const std::set<std::string>& quaternarySet,const std::set<std::string>& errorSet, int printType);
@@ -147,6 +169,7 @@ size_t getTotalFileSize(const std::vector<std::string>& files);
 // stds
 std::string trimWhitespace(const std::string& str);
 std::pair<std::string, std::string> extractDirectoryAndFilename(std::string_view path, const std::string& location);
+std::vector<dev_t> devicesOfPaths(const std::vector<std::string>& paths);
 
 
 // HISTORY
@@ -184,22 +207,44 @@ std::string modifyDirectoryPath(const std::string& dir);
 
 // CACHE
 
+// ISO cache entry with stat metadata and directory snapshots of a scan, defined in cache.h
+struct IsoCacheEntry;
+struct DirSnapshotScan;
+
+// Prepared filter query, defined in filter.h
+class FilterMatcher;
+
 // bools
-bool saveCache(const std::vector<std::string>& isoFiles, std::size_t maxCacheSize, std::atomic<bool>& newISOFound);
+bool saveCache(const std::vector<IsoCacheEntry>& isoFiles, std::size_t maxCacheSize, std::atomic<bool>& newISOFound, const DirSnapshotScan* snapshots = nullptr);
 bool clearAndLoadFiles(std::vector<std::string>& filteredFiles, bool& isFiltered, const std::string& listSubType);
+bool filterIsoFilesByTrigrams(const FilterMatcher& matcher, std::vector<size_t>& positions);
 
 // stds
 std::string getHomeDirectory();
 std::vector<std::string> loadCache();
+std::vector<std::optional<uint64_t>> getCachedFileSizes(const std::vector<std::string>& files);
+std::vector<std::string> loadAutoImportRoots();
 
 // voids
-void verboseIsoCacheRefresh(std::vector<std::string>& allIsoFiles, std::atomic<size_t>& totalFiles, std::vector<std::string>& validPaths, std::set<std::string>& invalidPaths, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& historyPattern, const std::chrono::high_resolution_clock::time_point& start_time, std::atomic<bool>& newISOFound);
+void verboseIsoCacheRefresh(std::vector<IsoCacheEntry>& allIsoFiles, std::atomic<size_t>& totalFiles, std::vector<std::string>& validPaths, std::set<std::string>& invalidPaths, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& historyPattern, const std::chrono::high_resolution_clock::time_point& start_time, std::atomic<bool>& newISOFound, DirSnapshotScan& snapshots);
 void cacheAndMiscSwitches (std::string& inputSearch, const bool& promptFlag, const int& maxDepth, const bool& historyPattern, std::atomic<bool>& newISOFound);
 void loadCache(std::vector<std::string>& isoFiles);
 void manualRefreshCache(std::string& initialDir, bool promptFlag, int maxDepth, bool historyPattern, std::atomic<bool>& newISOFound);
-void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::atomic<size_t>& totalFiles, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag);
+void traverse(const std::filesystem::path& path, std::vector<IsoCacheEntry>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::atomic<size_t>& totalFiles, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag, DirSnapshotScan& snapshots, std::atomic<bool>& cancelled);
 void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning, std::atomic<bool>& newISOFound);
 void removeNonExistentPathsFromCache();
+void loadDirSnapshots(DirSnapshotScan& scan);
+void applyCacheEvents(const std::vector<IsoCacheEntry>& added, const std::vector<std::string>& removedFiles, const std::vector<std::string>& removedDirs, std::atomic<bool>& newISOFound);
+void startCacheWatcher(std::atomic<bool>& newISOFound);
+
+
+// WALKER
+
+// Hooks for a directory walk, defined in walker.h
+struct DirectoryWalkVisitor;
+
+// voids
+void walkDirectoryTree(const std::string& root, int maxDepth, const DirectoryWalkVisitor& visitor, std::atomic<bool>& cancelled = g_operationCancelled);
 
 
 //	CP&MV&RM
@@ -215,8 +260,8 @@ void handleIsoFileOperation(const std::vector<std::string>& isoFiles, std::vecto
 
 // stds
 std::string removeAnsiCodes(const std::string& input);
-std::vector<size_t> boyerMooreSearch(const std::string& pattern, const std::string& text);
 std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query);
+std::vector<std::string> filterIsoFiles(const std::string& query, const std::vector<std::string>& filteredFiles, const IsoListView* filteredView, IsoListView& resultView);
 
 // voids
 void toLowerInPlace(std::string& str);
@@ -224,12 +269,13 @@ void toLowerInPlace(std::string& str);
 // WRITE2USB
 
 // bools
-bool writeIsoToDevice(const std::string& isoPath, const std::string& device, size_t progressIndex);
+bool writeIsoToDevice(const std::string& isoPath, const std::string& device, size_t progressIndex, bool verify);
 bool isUsbDevice(const std::string& devicePath);
 bool isDeviceMounted(const std::string& device);
 
 // voids
 void writeToUsb(const std::string& input, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages);
+void broadcastIsoToDevices(const std::string& isoPath, const std::vector<size_t>& progressIndices, const std::vector<std::string>& devices, bool verify);
 
 // stds
 std::string formatFileSize(uint64_t size);
@@ -241,14 +287,12 @@ std::vector<std::string> getRemovableDevices();
 
 // CONVERSION TOOLS
 
-// bools
-bool blacklist(const std::filesystem::path& entry, const bool& blacklistMdf, const bool& blacklistNrg);
-
 // stds
-std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind);
-std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, std::set<std::string>& fileNames, int& currentCacheOld, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback, const std::vector<std::string>& directoryPaths, std::set<std::string>& invalidDirectoryPaths, std::set<std::string>& processedErrorsFind);
+std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind, std::atomic<bool>& newISOFound);
+std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, std::set<std::string>& fileNames, int& currentCacheOld, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback, const std::vector<std::string>& directoryPaths, std::set<std::string>& invalidDirectoryPaths, std::set<std::string>& processedErrorsFind, std::atomic<bool>& newISOFound);
 
 // voids
+void addDiscoveredImageFiles(const std::vector<std::string>& binImgFiles, const std::vector<std::string>& mdfFiles, const std::vector<std::string>& nrgFiles);
 void convertToISO(const std::vector<std::string>& imageFiles, std::set<std::string>& successOuts, std::set<std::string>& skippedOuts, std::set<std::string>& failedOuts, std::set<std::string>& deletedOuts, const bool& modeMdf, const bool& modeNrg, int& maxDepth, bool& promptFlag, bool& historyPattern, std::atomic<size_t>* completedBytes, std::atomic<size_t>* completedTasks, std::atomic<size_t>* failedTasks, std::atomic<bool>& newISOFound);
 void verboseFind(std::set<std::string>& invalidDirectoryPaths, const std::vector<std::string>& directoryPaths,std::set<std::string>& processedErrorsFind);
 void verboseSearchResults(const std::string& fileExtension, std::set<std::string>& fileNames, std::set<std::string>& invalidDirectoryPaths, bool newFilesFound, bool list, int currentCacheOld, const std::vector<std::string>& files, const std::chrono::high_resolution_clock::time_point& start_time, std::set<std::string>& processedErrorsFind,std::vector<std::string>& directoryPaths);
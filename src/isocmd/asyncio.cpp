@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#include "../headers.h"
+#include "../asyncio.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+
+#ifdef HAVE_LIBURING
+// Ring with the queue's buffers registered, so the kernel maps them once instead of per request
+struct AsyncIoQueue::Ring {
+    struct io_uring uring;
+    bool registered = false;
+};
+#else
+struct AsyncIoQueue::Ring {};
+#endif
+
+
+AsyncIoQueue::AsyncIoQueue(size_t depth, size_t blockSize, size_t alignment) : bufferSize(blockSize) {
+    for (size_t i = 0; i < std::max<size_t>(depth, 1); ++i) {
+        void* buffer = nullptr;
+        if (posix_memalign(&buffer, alignment, std::max<size_t>(blockSize, 1)) != 0) {
+            for (char* allocated : buffers) std::free(allocated);
+            buffers.clear();
+            return;
+        }
+        buffers.push_back(static_cast<char*>(buffer));
+    }
+
+#ifdef HAVE_LIBURING
+    // Kernels or sandboxes without io_uring leave ring unset and use the writer thread
+    auto candidate = std::make_unique<Ring>();
+    if (io_uring_queue_init(static_cast<unsigned>(buffers.size() * 2), &candidate->uring, 0) == 0) {
+        std::vector<struct iovec> iovecs(buffers.size());
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            iovecs[i].iov_base = buffers[i];
+            iovecs[i].iov_len = bufferSize;
+        }
+        // Registration may hit RLIMIT_MEMLOCK on older kernels, plain requests still work then
+        candidate->registered = io_uring_register_buffers(&candidate->uring, iovecs.data(), static_cast<unsigned>(iovecs.size())) == 0;
+        ring = std::move(candidate);
+    }
+#endif
+}
+
+
+AsyncIoQueue::~AsyncIoQueue() {
+#ifdef HAVE_LIBURING
+    if (ring) {
+        io_uring_queue_exit(&ring->uring);
+    }
+#endif
+    if (retired) {
+        return;
+    }
+    for (char* buffer : buffers) {
+        std::free(buffer);
+    }
+}
+
+
+// Function to round a read up to the source's alignment, never past the buffer
+size_t AsyncIoQueue::alignedReadLength(size_t want, size_t alignment) const {
+    if (alignment == 0) {
+        return want;
+    }
+    return std::min(bufferSize, (want + alignment - 1) / alignment * alignment);
+}
+
+
+bool AsyncIoQueue::run(const Stream& stream, const Transform& transform, const Progress& progress) {
+    if (!valid()) {
+        return false;
+    }
+    if (stream.length == 0) {
+        return true;
+    }
+    return ring ? runRing(stream, transform, progress) : runThreaded(stream, transform, progress);
+}
+
+
+#ifdef HAVE_LIBURING
+// Function to keep every buffer busy: each one cycles read, transform, write, and a short
+// transfer is requeued for its remainder. Requests still in flight are always reaped before
+// returning, the kernel may be writing into the buffers until then. A ring that stops completing
+// them retires the queue for good.
+bool AsyncIoQueue::runRing(const Stream& stream, const Transform& transform, const Progress& progress) {
+    struct Slot {
+        uint64_t block = 0;
+        size_t want = 0;    // bytes the current read or write must move
+        size_t done = 0;
+        bool writing = false;
+    };
+
+    struct io_uring& uring = ring->uring;
+    const size_t stride = stream.outStride ? stream.outStride : bufferSize;
+    const uint64_t blockCount = (stream.length + bufferSize - 1) / bufferSize;
+
+    std::vector<Slot> slots(buffers.size());
+    std::vector<size_t> idle;
+    for (size_t i = buffers.size(); i-- > 0; ) idle.push_back(i);
+
+    uint64_t nextBlock = 0;
+    size_t inFlight = 0;
+    bool stopped = false;
+    bool failed = false;
+
+    auto readLength = [&](size_t want) {
+        return alignedReadLength(want, stream.readAlignment);
+    };
+
+    auto queue = [&](size_t index) {
+        Slot& slot = slots[index];
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&uring);
+        char* data = buffers[index] + slot.done;
+        unsigned length = static_cast<unsigned>(slot.want - slot.done);
+        if (slot.writing) {
+            const uint64_t offset = stream.outOffset + slot.block * stride + slot.done;
+            if (ring->registered) io_uring_prep_write_fixed(sqe, stream.out, data, length, offset, static_cast<int>(index));
+            else io_uring_prep_write(sqe, stream.out, data, length, offset);
+        } else {
+            const uint64_t offset = stream.inOffset + slot.block * bufferSize + slot.done;
+            length = static_cast<unsigned>(readLength(slot.want) - slot.done);
+            if (ring->registered) io_uring_prep_read_fixed(sqe, stream.in, data, length, offset, static_cast<int>(index));
+            else io_uring_prep_read(sqe, stream.in, data, length, offset);
+        }
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(index)));
+        ++inFlight;
+    };
+
+    while (true) {
+        if (g_operationCancelled.load(std::memory_order_relaxed)) {
+            failed = true;
+        }
+
+        while (!failed && !stopped && !idle.empty() && nextBlock < blockCount) {
+            const size_t index = idle.back();
+            idle.pop_back();
+            Slot& slot = slots[index];
+            slot.block = nextBlock++;
+            slot.want = static_cast<size_t>(std::min<uint64_t>(bufferSize, stream.length - slot.block * bufferSize));
+            slot.done = 0;
+            slot.writing = false;
+            queue(index);
+        }
+
+        if (inFlight == 0) {
+            break;
+        }
+
+        struct io_uring_cqe* cqe;
+        int waited = io_uring_submit_and_wait(&uring, 1);
+        if (waited < 0 && waited != -EINTR) {
+            // Queue nothing new but keep reaping until every request handed over has completed
+            failed = true;
+            if (io_uring_cq_ready(&uring) == 0) {
+                int result = -EAGAIN;
+                if (io_uring_sq_ready(&uring) == 0) {
+                    do {
+                        result = io_uring_wait_cqe(&uring, &cqe);
+                    } while (result == -EINTR);
+                }
+                if (result < 0) {
+                    // Nothing completes and nothing submits: the kernel may still own the buffers,
+                    // so the queue is retired and they are never freed or handed out again
+                    retired = true;
+                    return false;
+                }
+            }
+        }
+
+        unsigned head;
+        unsigned seen = 0;
+        io_uring_for_each_cqe(&uring, head, cqe) {
+            ++seen;
+            --inFlight;
+            const size_t index = static_cast<size_t>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+            Slot& slot = slots[index];
+            const int result = cqe->res;
+
+            if (result == -EINTR || result == -EAGAIN) {
+                if (!failed) {
+                    queue(index);
+                    continue;
+                }
+            }
+            if (failed || result <= 0) {
+                // A zero read means the source is shorter than the stream, a zero write a full device
+                failed = true;
+                idle.push_back(index);
+                continue;
+            }
+
+            slot.done += static_cast<size_t>(result);
+            if (slot.done < slot.want) {
+                queue(index);
+                continue;
+            }
+
+            if (slot.writing) {
+                if (progress) progress(slot.want);
+                idle.push_back(index);
+                continue;
+            }
+
+            // Read finished, hand the block to the transform and queue its write
+            ssize_t outBytes = static_cast<ssize_t>(slot.want);
+            if (transform) {
+                bool stop = false;
+                outBytes = transform(buffers[index], slot.want, slot.block, stop);
+                stopped = stopped || stop;
+            }
+            if (outBytes < 0) {
+                failed = true;
+            }
+            if (outBytes <= 0) {
+                idle.push_back(index);
+                continue;
+            }
+            slot.writing = true;
+            slot.want = static_cast<size_t>(outBytes);
+            slot.done = 0;
+            queue(index);
+        }
+        io_uring_cq_advance(&uring, seen);
+    }
+
+    return !failed && !g_operationCancelled.load(std::memory_order_relaxed);
+}
+#else
+bool AsyncIoQueue::runRing(const Stream& stream, const Transform& transform, const Progress& progress) {
+    return runThreaded(stream, transform, progress);
+}
+#endif
+
+
+// Function to overlap reads and writes without io_uring: the caller reads and transforms blocks
+// into free buffers while a writer thread drains the filled ones in order
+bool AsyncIoQueue::runThreaded(const Stream& stream, const Transform& transform, const Progress& progress) {
+    struct Filled {
+        size_t index;
+        uint64_t offset;
+        size_t length;
+    };
+
+    const size_t stride = stream.outStride ? stream.outStride : bufferSize;
+    const uint64_t blockCount = (stream.length + bufferSize - 1) / bufferSize;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<size_t> idle;
+    for (size_t i = buffers.size(); i-- > 0; ) idle.push_back(i);
+    std::queue<Filled> filled;
+    bool readerDone = false;
+    std::atomic<bool> failed{false};
+
+    std::thread writer([&]() {
+        while (true) {
+            Filled block;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return !filled.empty() || readerDone; });
+                if (filled.empty()) return;
+                block = filled.front();
+                filled.pop();
+            }
+
+            const char* data = buffers[block.index];
+            size_t written = 0;
+            while (!failed.load(std::memory_order_relaxed) && written < block.length) {
+                ssize_t result = pwrite(stream.out, data + written, block.length - written, static_cast<off_t>(block.offset + written));
+                if (result == -1 && errno == EINTR) continue;
+                if (result <= 0) {
+                    failed.store(true, std::memory_order_relaxed);
+                    break;
+                }
+                written += static_cast<size_t>(result);
+            }
+            if (written == block.length && progress) {
+                progress(block.length);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                idle.push_back(block.index);
+            }
+            cv.notify_all();
+        }
+    });
+
+    bool stopped = false;
+    for (uint64_t blockIndex = 0; blockIndex < blockCount && !stopped; ++blockIndex) {
+        if (failed.load(std::memory_order_relaxed) || g_operationCancelled.load(std::memory_order_relaxed)) {
+            failed.store(true, std::memory_order_relaxed);
+            break;
+        }
+
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return !idle.empty() || failed.load(std::memory_order_relaxed); });
+            if (idle.empty()) break;
+            index = idle.back();
+            idle.pop_back();
+        }
+
+        char* data = buffers[index];
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(bufferSize, stream.length - blockIndex * bufferSize));
+        const uint64_t offset = stream.inOffset + blockIndex * bufferSize;
+        const size_t length = alignedReadLength(want, stream.readAlignment);
+        size_t got = 0;
+        while (got < want) {
+            ssize_t result = pread(stream.in, data + got, length - got, static_cast<off_t>(offset + got));
+            if (result == -1 && errno == EINTR) continue;
+            if (result <= 0) break;
+            got += static_cast<size_t>(result);
+        }
+
+        ssize_t outBytes = static_cast<ssize_t>(want);
+        if (got < want) {
+            outBytes = -1;
+        } else if (transform) {
+            outBytes = transform(data, want, blockIndex, stopped);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (outBytes > 0) {
+            filled.push({index, stream.outOffset + blockIndex * stride, static_cast<size_t>(outBytes)});
+        } else {
+            idle.push_back(index);
+            if (outBytes < 0) failed.store(true, std::memory_order_relaxed);
+        }
+        cv.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        readerDone = true;
+    }
+    cv.notify_all();
+    writer.join();
+
+    return !failed.load() && !g_operationCancelled.load(std::memory_order_relaxed);
+}
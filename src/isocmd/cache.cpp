@@ -1,166 +1,684 @@
 // SPDX-License-Identifier: GNU General Public License v2.0
 
 #include "../headers.h"
+#include "../cache.h"
+#include "../threadpool.h"
+#include "../walker.h"
+#include "../isolist.h"
+#include "../filter.h"
 
 
 // Cache Variables
 
 const std::string cacheDirectory = std::string(std::getenv("HOME")) + "/.local/share/isocmd/database/"; // Construct the full path to the cache directory
-const std::string cacheFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_cache.txt";
-const std::string cacheFileName = "iso_commander_cache.txt";
+const std::string cacheFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_cache.bin";
+const std::string cacheFileName = "iso_commander_cache.bin";
+const std::string legacyCacheFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_cache.txt";
+const std::string dirSnapshotFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_dirs.bin";
+const std::string trigramIndexFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_trigrams.bin";
+const std::string cacheLockFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_cache.lock";
 const uintmax_t maxCacheSize = 10 * 1024 * 1024; // 10MB
 
+// Below this many cached ISOs a linear scan filters within a frame and no trigram index is kept
+const size_t trigramIndexMinEntries = 50000;
+
 // Global mutex to protect counter cout
 std::mutex couNtMutex;
 
-// Function to remove non-existent paths from cache
-void removeNonExistentPathsFromCache() {
-	
-	if (!std::filesystem::exists(cacheFilePath)) {
-        // If the file is missing, clear the ISO cache and return
-        globalIsoFileList.clear();
-        return;
+// Serializes read-modify-write cycles on the cache file
+static std::mutex cacheWriteMutex;
+
+
+// Holds cacheWriteMutex and an exclusive flock on the lock file. The cache is replaced by rename,
+// so the lock lives on a separate file that every isocmd process opens before reading the cache
+class CacheWriteLock {
+private:
+    std::lock_guard<std::mutex> guard{cacheWriteMutex};
+    int fd = -1;
+
+public:
+    CacheWriteLock() {
+        fd = open(cacheLockFilePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        while (fd != -1 && flock(fd, LOCK_EX) == -1 && errno == EINTR) {}
+    }
+
+    ~CacheWriteLock() {
+        if (fd != -1) {
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+    }
+
+    CacheWriteLock(const CacheWriteLock&) = delete;
+    CacheWriteLock& operator=(const CacheWriteLock&) = delete;
+};
+
+// Modification time of the cache file globalIsoFileList was last synced with, guarded by updateListMutex
+static std::filesystem::file_time_type lastLoadedCacheTime;
+
+
+// Path plus the record that will be written for it
+struct CacheWriteEntry {
+    std::string_view path;
+    IsoCacheRecord record;
+};
+
+
+// Function to build an on-disk record from a traversed entry
+static IsoCacheRecord recordFromEntry(const IsoCacheEntry& entry) {
+    IsoCacheRecord record{};
+    record.size = entry.size;
+    record.mtime = entry.mtime;
+    record.ino = entry.ino;
+    record.dev = entry.dev;
+    return record;
+}
+
+
+// Function to build an on-disk record from a stat result
+static IsoCacheRecord recordFromStat(const struct stat& st) {
+    IsoCacheRecord record{};
+    record.size = static_cast<uint64_t>(st.st_size);
+    record.mtime = statTimeToNs(st.st_mtim);
+    record.ino = static_cast<uint64_t>(st.st_ino);
+    record.dev = static_cast<uint64_t>(st.st_dev);
+    return record;
+}
+
+
+// Function to compare only the metadata part of two records
+static bool sameMetadata(const IsoCacheRecord& a, const IsoCacheRecord& b) {
+    return a.size == b.size && a.mtime == b.mtime && a.ino == b.ino && a.dev == b.dev;
+}
+
+
+// Function to append one LEB128 encoded value
+static void appendVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
     }
+    out.push_back(static_cast<char>(value));
+}
 
-    // Open the cache file for reading
-    int fd = open(cacheFilePath.c_str(), O_RDONLY);
+
+// Function to publish data at path through a temporary file that is synced before it is renamed
+// over path, so readers and a crash in between see either the old or the complete new file
+static bool publishFile(const std::string& path, const std::vector<char>& data) {
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
     if (fd == -1) {
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            close(fd);
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+
+    bool synced = fsync(fd) == 0;
+    if (close(fd) == -1 || !synced || rename(tmpPath.c_str(), path.c_str()) == -1) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// Function to rebuild the trigram index for a cache file that was just written. Postings of the
+// first unchangedPrefix entries are taken over from the index of the previous cache file when
+// that index is current, only the remaining paths are folded and hashed again
+static void writeTrigramIndex(const std::vector<CacheWriteEntry>& entries, size_t unchangedPrefix, const struct stat* previousCache) {
+    if (entries.size() < trigramIndexMinEntries) {
+        unlink(trigramIndexFilePath.c_str());
         return;
     }
 
-    // Lock the file to prevent concurrent access
-    if (flock(fd, LOCK_EX) == -1) {
-        close(fd);
+    struct stat cacheStat;
+    if (stat(cacheFilePath.c_str(), &cacheStat) != 0) {
         return;
     }
 
-    // Get the file size
-    struct stat sb;
-    if (fstat(fd, &sb) == -1) {
-        flock(fd, LOCK_UN);
-        close(fd);
+    std::vector<std::string> postings(TRIGRAM_BUCKETS);
+    std::vector<uint32_t> counts(TRIGRAM_BUCKETS, 0);
+    std::vector<uint32_t> lastEntries(TRIGRAM_BUCKETS, 0);
+    std::vector<uint32_t> decoded;
+
+    TrigramIndexView previous;
+    size_t start = 0;
+    if (unchangedPrefix > 0 && previousCache && previous.open(trigramIndexFilePath, *previousCache)) {
+        start = std::min<size_t>(unchangedPrefix, previous.entryCount());
+        for (uint32_t b = 0; b < TRIGRAM_BUCKETS; ++b) {
+            const TrigramBucket& bucket = previous.bucket(b);
+            if (bucket.count == 0) continue;
+
+            if (bucket.lastEntry < start) {
+                // The whole list survives, keep its bytes as they are
+                postings[b].assign(previous.postingBytes(b));
+                counts[b] = bucket.count;
+                lastEntries[b] = bucket.lastEntry;
+                continue;
+            }
+
+            // Cut the list at the first entry that moved
+            previous.decode(b, decoded);
+            for (uint32_t entry : decoded) {
+                if (entry >= start) break;
+                appendVarint(postings[b], counts[b] ? entry - lastEntries[b] : entry);
+                lastEntries[b] = entry;
+                ++counts[b];
+            }
+        }
+    }
+
+    std::string folded;
+    std::vector<uint32_t> buckets;
+    for (size_t i = start; i < entries.size(); ++i) {
+        folded.assign(entries[i].path);
+        toLowerInPlace(folded);
+        trigramBucketsOf(folded, buckets);
+
+        const uint32_t entry = static_cast<uint32_t>(i);
+        for (uint32_t b : buckets) {
+            appendVarint(postings[b], counts[b] ? entry - lastEntries[b] : entry);
+            lastEntries[b] = entry;
+            ++counts[b];
+        }
+    }
+
+    TrigramIndexHeader header{};
+    std::memcpy(header.magic, TRIGRAM_INDEX_MAGIC, sizeof(header.magic));
+    header.version = TRIGRAM_INDEX_VERSION;
+    header.headerSize = sizeof(TrigramIndexHeader);
+    header.cacheIno = static_cast<uint64_t>(cacheStat.st_ino);
+    header.cacheSize = static_cast<uint64_t>(cacheStat.st_size);
+    header.cacheMtime = statTimeToNs(cacheStat.st_mtim);
+    header.entryCount = entries.size();
+    for (const auto& list : postings) {
+        header.postingsSize += list.size();
+    }
+
+    const size_t tableSize = TRIGRAM_BUCKETS * sizeof(TrigramBucket);
+    std::vector<char> buffer(sizeof(TrigramIndexHeader) + tableSize + header.postingsSize);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    char* table = buffer.data() + sizeof(TrigramIndexHeader);
+    char* data = table + tableSize;
+    uint64_t offset = 0;
+    for (uint32_t b = 0; b < TRIGRAM_BUCKETS; ++b) {
+        TrigramBucket bucket{};
+        bucket.offset = offset;
+        bucket.length = static_cast<uint32_t>(postings[b].size());
+        bucket.count = counts[b];
+        bucket.lastEntry = lastEntries[b];
+        std::memcpy(table + b * sizeof(TrigramBucket), &bucket, sizeof(bucket));
+        std::memcpy(data + offset, postings[b].data(), postings[b].size());
+        offset += postings[b].size();
+    }
+    previous.reset();
+
+    publishFile(trigramIndexFilePath, buffer);
+}
+
+
+// Function to write ISO cache entries to disk in the binary format, previous is the view of the
+// cache being replaced and lets the trigram index keep the postings of entries that did not move
+static bool writeCacheFile(const std::string& path, const std::vector<CacheWriteEntry>& entries, int64_t validatedAt, const IsoCacheView* previous = nullptr) {
+    struct stat previousStat;
+    bool hadPrevious = previous && !previous->empty() && stat(path.c_str(), &previousStat) == 0;
+    size_t unchangedPrefix = 0;
+    if (hadPrevious) {
+        while (unchangedPrefix < entries.size() && unchangedPrefix < previous->size() &&
+               entries[unchangedPrefix].path == (*previous)[unchangedPrefix]) {
+            ++unchangedPrefix;
+        }
+    }
+
+    uint64_t blobSize = 0;
+    for (const auto& entry : entries) {
+        blobSize += entry.path.size();
+    }
+
+    IsoCacheHeader header{};
+    std::memcpy(header.magic, ISO_CACHE_MAGIC, sizeof(header.magic));
+    header.version = ISO_CACHE_VERSION;
+    header.headerSize = sizeof(IsoCacheHeader);
+    header.entryCount = entries.size();
+    header.blobSize = blobSize;
+    header.validatedAt = validatedAt;
+
+    const size_t tableSize = entries.size() * sizeof(IsoCacheRecord);
+
+    // Assemble the whole file in memory so it can be written with a handful of syscalls
+    std::vector<char> buffer(sizeof(IsoCacheHeader) + tableSize + blobSize);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    char* table = buffer.data() + sizeof(IsoCacheHeader);
+    char* blob = table + tableSize;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        IsoCacheRecord record = entries[i].record;
+        record.pathOffset = offset;
+        record.pathLength = static_cast<uint32_t>(entries[i].path.size());
+        record.reserved = 0;
+        std::memcpy(table + i * sizeof(IsoCacheRecord), &record, sizeof(record));
+        std::memcpy(blob + offset, entries[i].path.data(), entries[i].path.size());
+        offset += entries[i].path.size();
+    }
+
+    if (!publishFile(path, buffer)) {
+        return false;
+    }
+
+    writeTrigramIndex(entries, unchangedPrefix, hadPrevious ? &previousStat : nullptr);
+    return true;
+}
+
+
+// Function to split a run of '\0' terminated names from the snapshot blob
+static void readSnapshotNames(const char* name, uint64_t length, std::vector<std::string>& names) {
+    const char* namesEnd = name + length;
+    while (name < namesEnd) {
+        const char* nameEnd = static_cast<const char*>(std::memchr(name, '\0', namesEnd - name));
+        if (!nameEnd) break;
+        names.emplace_back(name, nameEnd);
+        name = nameEnd + 1;
+    }
+}
+
+
+// Function to load directory snapshots of the previous scan
+void loadDirSnapshots(DirSnapshotScan& scan) {
+    scan.previous.clear();
+
+    // Snapshots only describe what is already in the ISO cache, without it they are meaningless
+    struct stat cacheStat;
+    if (stat(cacheFilePath.c_str(), &cacheStat) != 0) {
         return;
     }
 
-    size_t fileSize = sb.st_size;
+    int fd = open(dirSnapshotFilePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+
+    struct stat st;
+    if (flock(fd, LOCK_SH) == -1 || fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(DirSnapshotHeader)) {
+        close(fd);
+        return;
+    }
 
-    // Memory map the file
+    size_t fileSize = static_cast<size_t>(st.st_size);
     char* mappedFile = static_cast<char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
+    flock(fd, LOCK_UN);
+    close(fd);
     if (mappedFile == MAP_FAILED) {
-        flock(fd, LOCK_UN);
-        close(fd);
         return;
     }
 
-    // Read the file into a vector of strings
-    std::vector<std::string> cache;
-    char* start = mappedFile;
-    char* end = mappedFile + fileSize;
-    while (start < end) {
-        char* lineEnd = std::find(start, end, '\n');
-        cache.emplace_back(start, lineEnd);
-        start = lineEnd + 1;
+    DirSnapshotHeader header;
+    std::memcpy(&header, mappedFile, sizeof(header));
+    const uint64_t maxEntries = (fileSize - sizeof(DirSnapshotHeader)) / sizeof(DirSnapshotRecord);
+    if (std::memcmp(header.magic, DIR_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != DIR_SNAPSHOT_VERSION || header.headerSize != sizeof(DirSnapshotHeader) ||
+        header.entryCount > maxEntries ||
+        header.blobSize != fileSize - sizeof(DirSnapshotHeader) - header.entryCount * sizeof(DirSnapshotRecord)) {
+        munmap(mappedFile, fileSize);
+        return;
+    }
+
+    const char* table = mappedFile + sizeof(DirSnapshotHeader);
+    const char* blob = table + header.entryCount * sizeof(DirSnapshotRecord);
+    scan.previous.reserve(header.entryCount);
+
+    for (uint64_t i = 0; i < header.entryCount; ++i) {
+        DirSnapshotRecord record;
+        std::memcpy(&record, table + i * sizeof(DirSnapshotRecord), sizeof(record));
+        if (record.pathOffset > header.blobSize || record.pathLength > header.blobSize - record.pathOffset ||
+            record.subdirsOffset > header.blobSize || record.subdirsLength > header.blobSize - record.subdirsOffset ||
+            record.imagesOffset > header.blobSize || record.imagesLength > header.blobSize - record.imagesOffset) {
+            scan.previous.clear();
+            break;
+        }
+
+        DirSnapshot snapshot;
+        snapshot.path.assign(blob + record.pathOffset, record.pathLength);
+        snapshot.mtime = record.mtime;
+        snapshot.ctime = record.ctime;
+        snapshot.ino = record.ino;
+        snapshot.dev = record.dev;
+        snapshot.fileCount = record.fileCount;
+        snapshot.subdirs.reserve(record.subdirCount);
+        readSnapshotNames(blob + record.subdirsOffset, record.subdirsLength, snapshot.subdirs);
+
+        std::vector<std::string> images;
+        images.reserve(record.imageCount);
+        readSnapshotNames(blob + record.imagesOffset, record.imagesLength, images);
+        snapshot.images.reserve(images.size());
+        for (auto& image : images) {
+            if (image.size() < 2) continue;
+            snapshot.images.push_back({static_cast<uint8_t>(image[0]), image.substr(1)});
+        }
+
+        std::string key = snapshot.path;
+        scan.previous.emplace(std::move(key), std::move(snapshot));
     }
 
-    // Unmap and close the file
     munmap(mappedFile, fileSize);
-    flock(fd, LOCK_UN);
-    close(fd);
+}
 
-    // Determine batch size
-    const size_t maxThreads = std::thread::hardware_concurrency();
-    const size_t batchSize = std::max(cache.size() / maxThreads + 1, static_cast<size_t>(2));
-
-    // Create a vector to hold futures
-    std::vector<std::future<std::vector<std::string>>> futures;
-
-    // Process paths in batches
-    for (size_t i = 0; i < cache.size(); i += batchSize) {
-        auto begin = cache.begin() + i;
-        auto end = std::min(begin + batchSize, cache.end());
-            futures.push_back(std::async(std::launch::async, [begin, end]() {
-            std::vector<std::string> result;
-            for (auto it = begin; it != end; ++it) {
-                if (std::filesystem::exists(*it)) {
-                    result.push_back(*it);
+
+// Function to merge the snapshots of a finished scan with the stored ones and write them to disk
+static void commitDirSnapshots(const DirSnapshotScan& scan) {
+    // Directories read during this scan replace their previous snapshot
+    std::unordered_map<std::string_view, const DirSnapshot*> merged;
+    merged.reserve(scan.previous.size() + scan.current.size());
+    for (const auto& snapshot : scan.current) {
+        merged[snapshot.path] = &snapshot;
+    }
+    for (const auto& [path, snapshot] : scan.previous) {
+        merged.emplace(path, &snapshot);
+    }
+
+    // Parents come before children when sorted by length, so vanished subtrees are pruned top-down
+    std::vector<const DirSnapshot*> ordered;
+    ordered.reserve(merged.size());
+    for (const auto& [path, snapshot] : merged) {
+        ordered.push_back(snapshot);
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const DirSnapshot* a, const DirSnapshot* b) {
+        return a->path.size() != b->path.size() ? a->path.size() < b->path.size() : a->path < b->path;
+    });
+
+    std::unordered_set<std::string_view> removed;
+    std::vector<const DirSnapshot*> kept;
+    kept.reserve(ordered.size());
+    for (const DirSnapshot* snapshot : ordered) {
+        std::string_view path = snapshot->path;
+        size_t slash = path.rfind('/');
+        if (slash != std::string_view::npos && path.size() > 1) {
+            std::string_view parent = path.substr(0, slash == 0 ? 1 : slash);
+            std::string_view name = path.substr(slash + 1);
+            if (removed.count(parent)) {
+                removed.insert(path);
+                continue;
+            }
+            auto parentIt = merged.find(parent);
+            if (parentIt != merged.end()) {
+                const auto& siblings = parentIt->second->subdirs;
+                if (std::find(siblings.begin(), siblings.end(), name) == siblings.end()) {
+                    removed.insert(path);
+                    continue;
                 }
             }
-            return result;
-        }));
+        }
+        kept.push_back(snapshot);
     }
 
-    // Collect results
-    std::vector<std::string> retainedPaths;
-    for (auto& future : futures) {
-        auto result = future.get();
-        retainedPaths.insert(retainedPaths.end(), std::make_move_iterator(result.begin()), std::make_move_iterator(result.end()));
+    uint64_t blobSize = 0;
+    for (const DirSnapshot* snapshot : kept) {
+        blobSize += snapshot->path.size();
+        for (const auto& name : snapshot->subdirs) {
+            blobSize += name.size() + 1;
+        }
+        for (const auto& image : snapshot->images) {
+            blobSize += image.name.size() + 2;
+        }
     }
-    
-    // Check if the retained paths are the same as the original cache
-	if (cache.size() == retainedPaths.size() && 
-		std::equal(cache.begin(), cache.end(), retainedPaths.begin())) {
-		// No changes needed, return without modifying the file
-		return;
-	}
 
-	// Only rewrite the file if there are changes
-	std::ofstream updatedCacheFile(cacheFilePath, std::ios::out | std::ios::trunc);
-	if (!updatedCacheFile.is_open()) {
-		flock(fd, LOCK_UN);
-		close(fd);
-		return;
-	}
+    DirSnapshotHeader header{};
+    std::memcpy(header.magic, DIR_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = DIR_SNAPSHOT_VERSION;
+    header.headerSize = sizeof(DirSnapshotHeader);
+    header.entryCount = kept.size();
+    header.blobSize = blobSize;
+
+    const size_t tableSize = kept.size() * sizeof(DirSnapshotRecord);
+    std::vector<char> buffer(sizeof(DirSnapshotHeader) + tableSize + blobSize);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    char* table = buffer.data() + sizeof(DirSnapshotHeader);
+    char* blob = table + tableSize;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < kept.size(); ++i) {
+        const DirSnapshot& snapshot = *kept[i];
+        DirSnapshotRecord record{};
+        record.pathOffset = offset;
+        record.pathLength = static_cast<uint32_t>(snapshot.path.size());
+        std::memcpy(blob + offset, snapshot.path.data(), snapshot.path.size());
+        offset += snapshot.path.size();
+
+        record.subdirCount = static_cast<uint32_t>(snapshot.subdirs.size());
+        record.subdirsOffset = offset;
+        for (const auto& name : snapshot.subdirs) {
+            std::memcpy(blob + offset, name.data(), name.size());
+            offset += name.size();
+            blob[offset++] = '\0';
+        }
+        record.subdirsLength = offset - record.subdirsOffset;
+
+        record.imageCount = static_cast<uint32_t>(snapshot.images.size());
+        record.imagesOffset = offset;
+        for (const auto& image : snapshot.images) {
+            blob[offset++] = static_cast<char>(image.type);
+            std::memcpy(blob + offset, image.name.data(), image.name.size());
+            offset += image.name.size();
+            blob[offset++] = '\0';
+        }
+        record.imagesLength = offset - record.imagesOffset;
+        record.mtime = snapshot.mtime;
+        record.ctime = snapshot.ctime;
+        record.ino = snapshot.ino;
+        record.dev = snapshot.dev;
+        record.fileCount = snapshot.fileCount;
+        std::memcpy(table + i * sizeof(DirSnapshotRecord), &record, sizeof(record));
+    }
 
-    // Open the cache file for writing
-    fd = open(cacheFilePath.c_str(), O_WRONLY);
-    if (fd == -1) {
+    publishFile(dirSnapshotFilePath, buffer);
+}
+
+
+// Function to convert the old line based text cache to the binary format once
+static void migrateLegacyCache() {
+    struct stat st;
+    if (stat(cacheFilePath.c_str(), &st) == 0 || stat(legacyCacheFilePath.c_str(), &st) != 0) {
         return;
     }
 
-    // Lock the file to prevent concurrent access
-    if (flock(fd, LOCK_EX) == -1) {
-        close(fd);
+    int fd = open(legacyCacheFilePath.c_str(), O_RDONLY);
+    if (fd == -1) {
         return;
     }
 
-    // Write the retained paths to the updated cache file
-    if (!updatedCacheFile.is_open()) {
-        flock(fd, LOCK_UN);
+    if (flock(fd, LOCK_SH) == -1) {
         close(fd);
         return;
     }
 
-    for (const std::string& path : retainedPaths) {
-		if (std::filesystem::exists(path)) {
-			updatedCacheFile << path << '\n';
-		}
-	}
+    std::vector<CacheWriteEntry> entries;
+    char* mappedFile = nullptr;
+    size_t fileSize = static_cast<size_t>(st.st_size);
 
-    // RAII: Close the file and release the lock
+    if (fileSize > 0) {
+        mappedFile = static_cast<char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
+        if (mappedFile == MAP_FAILED) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            return;
+        }
+
+        char* start = mappedFile;
+        char* end = mappedFile + fileSize;
+        while (start < end) {
+            char* lineEnd = std::find(start, end, '\n');
+            if (lineEnd != start) {
+                // Legacy entries carry no metadata until the next scan or validation fills it in
+                entries.push_back({std::string_view(start, static_cast<size_t>(lineEnd - start)), IsoCacheRecord{}});
+            }
+            start = lineEnd + 1;
+        }
+    }
+
+    bool migrated = writeCacheFile(cacheFilePath, entries, 0);
+
+    if (mappedFile) {
+        munmap(mappedFile, fileSize);
+    }
     flock(fd, LOCK_UN);
     close(fd);
+
+    if (migrated) {
+        unlink(legacyCacheFilePath.c_str());
+    }
 }
 
 
-// Count ISOCache entries for stats
-int countNonEmptyLines(const std::string& filePath) {
-    std::ifstream file(filePath);
-    if (!file.is_open()) {
-        std::cerr << "Unable to open file: " << filePath << std::endl;
-        return -1;
+// Function to get the current wall clock time in the ns format used by the cache
+static int64_t currentTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return statTimeToNs(ts);
+}
+
+
+// Function to remove non-existent paths from cache
+void removeNonExistentPathsFromCache() {
+    CacheWriteLock writeLock;
+    migrateLegacyCache();
+
+    IsoCacheView cache;
+    if (!cache.open(cacheFilePath)) {
+        // If the file is missing, clear the ISO cache and return
+        if (!std::filesystem::exists(cacheFilePath)) {
+            globalIsoFileList.clear();
+            globalIsoListIndex.clear();
+        }
+        return;
+    }
+
+    // Everything that survives this pass is known to exist as of this moment
+    const int64_t validationStart = currentTimeNs();
+
+    // Filesystem timestamps come from a coarse clock (and from the server on NFS), so only
+    // directories clearly older than the last validation are trusted without per-file checks
+    const int64_t clockSlack = 2000000000LL;
+    const int64_t trustedBefore = cache.validatedAt() > clockSlack ? cache.validatedAt() - clockSlack : 0;
+
+    // Group entries by parent directory so each directory is stat'ed once
+    std::vector<std::string_view> directories;
+    std::unordered_map<std::string_view, size_t> directoryIndex;
+    std::vector<size_t> entryDirectory(cache.size());
+    for (size_t i = 0; i < cache.size(); ++i) {
+        std::string_view entryPath = cache[i];
+        size_t slash = entryPath.rfind('/');
+        std::string_view parent = slash == std::string_view::npos ? std::string_view() : entryPath.substr(0, slash == 0 ? 1 : slash);
+        auto [it, inserted] = directoryIndex.emplace(parent, directories.size());
+        if (inserted) {
+            directories.push_back(parent);
+        }
+        entryDirectory[i] = it->second;
+    }
+
+    // Determine batch size
+    const size_t workers = globalThreadPool().size();
+
+    // 0 = unchanged since last validation, 1 = changed, 2 = missing
+    std::vector<char> directoryState(directories.size(), 1);
+    {
+        const size_t batchSize = std::max(directories.size() / workers + 1, static_cast<size_t>(2));
+        TaskGroup tasks;
+        for (size_t i = 0; i < directories.size(); i += batchSize) {
+            size_t begin = i;
+            size_t end = std::min(i + batchSize, directories.size());
+            tasks.run([&directories, &directoryState, trustedBefore, begin, end]() {
+                std::string path;
+                struct stat st;
+                for (size_t j = begin; j < end; ++j) {
+                    path.assign(directories[j]);
+                    if (stat(path.c_str(), &st) != 0) {
+                        directoryState[j] = 2;
+                    } else if (trustedBefore > 0 && statTimeToNs(st.st_mtim) < trustedBefore) {
+                        directoryState[j] = 0;
+                    }
+                }
+            });
+        }
+        tasks.wait();
+    }
+
+    // Only entries in changed directories, or without metadata, need their own stat
+    std::vector<size_t> toCheck;
+    for (size_t i = 0; i < cache.size(); ++i) {
+        char state = directoryState[entryDirectory[i]];
+        if (state == 1 || (state == 0 && cache.record(i).ino == 0)) {
+            toCheck.push_back(i);
+        }
     }
 
-    int nonEmptyLineCount = 0;
-    std::string line;
-    while (std::getline(file, line)) {
-        // Check if the line is not empty (ignoring whitespace)
-        if (!line.empty() && line.find_first_not_of(" \t\n\r\f\v") != std::string::npos) {
-            ++nonEmptyLineCount;
+    // 0 = drop, 1 = keep as is, 2 = keep with refreshed metadata
+    std::vector<char> entryState(cache.size(), 1);
+    for (size_t i = 0; i < cache.size(); ++i) {
+        if (directoryState[entryDirectory[i]] == 2) {
+            entryState[i] = 0;
         }
     }
+    std::vector<IsoCacheRecord> refreshed(cache.size());
+    {
+        const size_t batchSize = std::max(toCheck.size() / workers + 1, static_cast<size_t>(2));
+        TaskGroup tasks;
+        for (size_t i = 0; i < toCheck.size(); i += batchSize) {
+            size_t begin = i;
+            size_t end = std::min(i + batchSize, toCheck.size());
+            tasks.run([&cache, &toCheck, &entryState, &refreshed, begin, end]() {
+                std::string path;
+                struct stat st;
+                for (size_t j = begin; j < end; ++j) {
+                    size_t index = toCheck[j];
+                    path.assign(cache[index]);
+                    if (stat(path.c_str(), &st) != 0) {
+                        entryState[index] = 0;
+                        continue;
+                    }
+                    refreshed[index] = recordFromStat(st);
+                    if (!sameMetadata(refreshed[index], cache.record(index))) {
+                        entryState[index] = 2;
+                    }
+                }
+            });
+        }
+        tasks.wait();
+    }
 
-    file.close();
-    return nonEmptyLineCount;
+    // Collect results
+    std::vector<CacheWriteEntry> retainedEntries;
+    retainedEntries.reserve(cache.size());
+    bool changed = false;
+    for (size_t i = 0; i < cache.size(); ++i) {
+        if (entryState[i] == 0) {
+            changed = true;
+            continue;
+        }
+        if (entryState[i] == 2) {
+            changed = true;
+            retainedEntries.push_back({cache[i], refreshed[i]});
+        } else {
+            retainedEntries.push_back({cache[i], cache.record(i)});
+        }
+    }
+
+    // No changes needed, return without modifying the file unless it was never validated
+    if (!changed && cache.validatedAt() != 0) {
+        return;
+    }
+
+    writeCacheFile(cacheFilePath, retainedEntries, validationStart, &cache);
 }
 
 
@@ -180,38 +698,39 @@ bool clearAndLoadFiles(std::vector<std::string>& filteredFiles, bool& isFiltered
 	signal(SIGINT, SIG_IGN);        // Ignore Ctrl+C
 	disable_ctrl_d();
 	
-    static std::filesystem::file_time_type lastModifiedTime;
-
-    // Check if the cache file exists and has been modified
-    bool needToReload = false;
-    if (std::filesystem::exists(cacheFilePath)) {
-        std::filesystem::file_time_type currentModifiedTime = 
-            std::filesystem::last_write_time(cacheFilePath);
+    // Common operations
+    clearScrollBuffer();
+    {
+        std::lock_guard<std::mutex> lock(updateListMutex);
+
+        // Check if the cache file exists and has been modified
+        bool needToReload = false;
+        std::error_code ec;
+        std::filesystem::file_time_type currentModifiedTime = std::filesystem::last_write_time(cacheFilePath, ec);
+        if (!ec) {
+            if (lastLoadedCacheTime == std::filesystem::file_time_type{}) {
+                // First time checking, always load
+                needToReload = true;
+            } else if (currentModifiedTime != lastLoadedCacheTime) {
+                // Cache file has been modified since last load
+                needToReload = true;
+            }
 
-        if (lastModifiedTime == std::filesystem::file_time_type{}) {
-            // First time checking, always load
-            needToReload = true;
-        } else if (currentModifiedTime > lastModifiedTime) {
-            // Cache file has been modified since last load
+            // Update last modified time
+            lastLoadedCacheTime = currentModifiedTime;
+        } else {
+            // Cache file doesn't exist, need to load
             needToReload = true;
+            lastLoadedCacheTime = std::filesystem::file_time_type{};
         }
 
-        // Update last modified time
-        lastModifiedTime = currentModifiedTime;
-    } else {
-        // Cache file doesn't exist, need to load
-        needToReload = true;
-    }
-
-    // Common operations
-    clearScrollBuffer();
-    if (needToReload) {
-        loadCache(globalIsoFileList);
+        // The index keeps the list sorted between reloads, so only a reload sorts
+        if (needToReload) {
+            loadCache(globalIsoFileList);
+            globalIsoListIndex.assign(globalIsoFileList);
+            globalIsoListIndex.sort(globalIsoFileList);
+        }
     }
-	{
-		std::lock_guard<std::mutex> lock(updateListMutex);
-		sortFilesCaseInsensitive(globalIsoFileList);
-	}
     
     printList(isFiltered ? filteredFiles : globalIsoFileList, "ISO_FILES", listSubType);
 
@@ -226,24 +745,15 @@ bool clearAndLoadFiles(std::vector<std::string>& filteredFiles, bool& isFiltered
 }
 
 
-// Function to auto-import ISO files in cache without blocking the UI
-void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning, std::atomic<bool>& newISOFound) {
+// Function to read the folder roots used by automatic imports from the history file, nested folders are folded into their parents
+std::vector<std::string> loadAutoImportRoots() {
     std::vector<std::string> paths;
-    int localMaxDepth = maxDepthParam;
-    bool localPromptFlag = false;
-    const size_t maxThreadsX2 = (std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency()) * 2;
-
-    // Local condition variable and mutex
-    std::condition_variable cv;
-    std::mutex threadMutex;
-    std::atomic<size_t> activeThreads{0};
 
     // Read paths from file
     {
         std::ifstream file(historyFilePath);
         if (!file.is_open()) {
-            isImportRunning.store(false);
-            return;
+            return {};
         }
 
         std::string line;
@@ -291,47 +801,48 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
         }
     }
 
+    return finalPaths;
+}
+
+
+// Function to auto-import ISO files in cache without blocking the UI
+void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning, std::atomic<bool>& newISOFound) {
+    int localMaxDepth = maxDepthParam;
+    bool localPromptFlag = false;
+
+    std::vector<std::string> finalPaths = loadAutoImportRoots();
+    if (finalPaths.empty()) {
+        isImportRunning.store(false);
+        return;
+    }
+
     // Process paths with thread limit
-    std::vector<std::string> allIsoFiles;
+    std::vector<IsoCacheEntry> allIsoFiles;
     std::atomic<size_t> totalFiles{0};
     std::set<std::string> uniqueErrorMessages;
     std::mutex processMutex;
     std::mutex traverseErrorMutex;
+    DirSnapshotScan snapshots;
+    loadDirSnapshots(snapshots);
 
-    std::vector<std::future<void>> futures;
+    // Roots share the process-wide pool with whatever the user is doing meanwhile. The import has
+    // its own cancellation flag, it must neither clear nor react to the user's Ctrl+C
+    std::atomic<bool> importCancelled{false};
+    TaskGroup tasks(globalThreadPool(), &importCancelled);
     for (const auto& path : finalPaths) {
         if (isValidDirectory(path)) {
-            // Wait until the number of active threads is less than maxThreads * 2
-            std::unique_lock<std::mutex> lock(threadMutex);
-            cv.wait(lock, [&]() { return activeThreads < maxThreadsX2; });
-
-            // Increment the active thread count
-            activeThreads++;
-
-            // Launch the task asynchronously
-            futures.push_back(std::async(std::launch::async, [&, path]() {
+            tasks.run([&, path]() {
                 traverse(path, allIsoFiles, uniqueErrorMessages,
                          totalFiles, processMutex, traverseErrorMutex,
-                         localMaxDepth, localPromptFlag);
-
-                // Decrement the active thread count when done
-                {
-                    std::unique_lock<std::mutex> lock(threadMutex);
-                    activeThreads--;
-                }
-
-                // Notify the waiting thread that a thread has finished
-                cv.notify_one();
-            }));
+                         localMaxDepth, localPromptFlag, snapshots, importCancelled);
+            });
         }
     }
 
     // Wait for all tasks to complete
-    for (auto& future : futures) {
-        future.wait();
-    }
+    tasks.wait();
 
-    saveCache(allIsoFiles, maxCacheSize, newISOFound);
+    saveCache(allIsoFiles, maxCacheSize, newISOFound, &snapshots);
 
     isImportRunning.store(false);
 }
@@ -339,113 +850,334 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
 
 // Function to load ISO cache from file
 void loadCache(std::vector<std::string>& isoFiles) {
-    std::string cacheFilePath = getHomeDirectory() + "/.local/share/isocmd/database/iso_commander_cache.txt";
-
-    int fd = open(cacheFilePath.c_str(), O_RDONLY);
-    if (fd == -1) {
-        return; // File doesn't exist or cannot be opened
+    {
+        CacheWriteLock writeLock;
+        migrateLegacyCache();
     }
 
-    // Acquire a shared lock using flock
-    if (flock(fd, LOCK_SH) == -1) {
-        close(fd);
+    IsoCacheView cache;
+    if (!cache.open(cacheFilePath)) {
+        if (!std::filesystem::exists(cacheFilePath)) {
+            return; // File doesn't exist or cannot be opened
+        }
+        isoFiles.clear();
         return;
     }
 
-    struct stat fileStat;
-    if (fstat(fd, &fileStat) == -1 || fileStat.st_size == 0) {
-        flock(fd, LOCK_UN);
-        close(fd);
-        isoFiles.clear();
-        return;
+    // The ISO list is handed to printList, the filters and every operation as std::string, so
+    // paths are copied once here per cache change. Only a reload pays for it, the watcher
+    // patches the list in place and the trigram filter reads the mapping directly
+    std::vector<std::string> loadedFiles;
+    loadedFiles.reserve(cache.size());
+    for (size_t i = 0; i < cache.size(); ++i) {
+        if (!cache[i].empty()) {
+            loadedFiles.emplace_back(cache[i]);
+        }
     }
 
-    const auto fileSize = fileStat.st_size;
+    isoFiles.swap(loadedFiles);
+}
 
-    char* mappedFile = static_cast<char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
-    if (mappedFile == MAP_FAILED) {
-        flock(fd, LOCK_UN);
-        close(fd);
-        return;
+
+// Trigram index and cache kept mapped between lookups, reopened whenever the cache file
+// changes, guarded by updateListMutex
+static TrigramIndexView lookupIndex;
+static IsoCacheView lookupCache;
+static struct stat lookupCacheStat;
+static bool lookupMapped = false;
+
+
+// Function to filter globalIsoFileList through the trigram index, the caller holds updateListMutex.
+// Returns false when the index cannot answer the query and the list has to be scanned instead
+bool filterIsoFilesByTrigrams(const FilterMatcher& matcher, std::vector<size_t>& positions) {
+    if (globalIsoListIndex.size() < trigramIndexMinEntries) {
+        return false;
     }
 
-    std::vector<std::string> loadedFiles;
+    // Only plain substrings can be looked up, and every token needs at least one trigram
+    if (matcher.filterMode() != FilterMode::Substring) {
+        return false;
+    }
+    for (const std::string& token : matcher.tokenList()) {
+        if (token.size() < 3) {
+            return false;
+        }
+    }
 
-    char* start = mappedFile;
-    char* end = mappedFile + fileSize;
-    while (start < end) {
-        char* lineEnd = std::find(start, end, '\n');
-        std::string line(start, lineEnd);
-        start = lineEnd + 1;
+    // The list has to mirror the cache file the index was built from
+    std::error_code ec;
+    struct stat cacheStat;
+    if (lastLoadedCacheTime == std::filesystem::file_time_type{} ||
+        std::filesystem::last_write_time(cacheFilePath, ec) != lastLoadedCacheTime || ec ||
+        stat(cacheFilePath.c_str(), &cacheStat) != 0) {
+        return false;
+    }
+
+    if (!lookupMapped || cacheStat.st_ino != lookupCacheStat.st_ino || cacheStat.st_size != lookupCacheStat.st_size ||
+        statTimeToNs(cacheStat.st_mtim) != statTimeToNs(lookupCacheStat.st_mtim)) {
+        lookupMapped = lookupIndex.open(trigramIndexFilePath, cacheStat) && lookupCache.open(cacheFilePath) &&
+                       lookupCache.size() == lookupIndex.entryCount();
+        lookupCacheStat = cacheStat;
+    }
+    if (!lookupMapped) {
+        return false;
+    }
+
+    // A list patched by applyCacheEvents no longer knows where its entries sit in the cache
+    if (!globalIsoListIndex.sourcesCurrent()) {
+        globalIsoListIndex.mapSources(globalIsoFileList, lookupCache.size(), [](size_t i) { return lookupCache[i]; });
+    }
+
+    std::vector<uint32_t> matched;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> list;
+    std::vector<uint32_t> buckets;
+    for (const std::string& token : matcher.tokenList()) {
+        trigramBucketsOf(token, buckets);
+        std::sort(buckets.begin(), buckets.end(), [](uint32_t a, uint32_t b) {
+            return lookupIndex.bucket(a).count < lookupIndex.bucket(b).count;
+        });
+
+        // Intersect from the shortest list up, once the survivors are few compared to the
+        // next list it is cheaper to check them against their paths directly
+        lookupIndex.decode(buckets[0], candidates);
+        for (size_t k = 1; k < buckets.size() && !candidates.empty(); ++k) {
+            if (lookupIndex.bucket(buckets[k]).count > 32 * candidates.size()) {
+                break;
+            }
+            lookupIndex.decode(buckets[k], list);
+            candidates.erase(std::set_intersection(candidates.begin(), candidates.end(), list.begin(), list.end(), candidates.begin()), candidates.end());
+        }
 
-        if (!line.empty()) {
-            loadedFiles.push_back(std::move(line));
+        for (uint32_t entry : candidates) {
+            if (entry < lookupCache.size() && matcher.matchesPlain(lookupCache[entry])) {
+                matched.push_back(entry);
+            }
         }
     }
 
-    munmap(mappedFile, fileSize);
-    flock(fd, LOCK_UN);
-    close(fd);
+    std::sort(matched.begin(), matched.end());
+    matched.erase(std::unique(matched.begin(), matched.end()), matched.end());
 
-    isoFiles.swap(loadedFiles);
+    positions.clear();
+    positions.reserve(matched.size());
+    for (uint32_t entry : matched) {
+        size_t position = globalIsoListIndex.positionOfSource(entry);
+        if (position == IsoListIndex::npos || globalIsoFileList[position] != lookupCache[entry]) {
+            position = globalIsoListIndex.find(globalIsoFileList, lookupCache[entry]);
+        }
+        if (position != IsoListIndex::npos) {
+            positions.push_back(position);
+        }
+    }
+    std::sort(positions.begin(), positions.end());
+    return true;
 }
 
 
 // Function to save ISO cache to file
-bool saveCache(const std::vector<std::string>& isoFiles, std::size_t maxCacheSize, std::atomic<bool>& newISOFound) {
-    std::filesystem::path cachePath = cacheDirectory;
-    cachePath /= cacheFileName;
+bool saveCache(const std::vector<IsoCacheEntry>& isoFiles, std::size_t maxCacheSize, std::atomic<bool>& newISOFound, const DirSnapshotScan* snapshots) {
     if (!std::filesystem::exists(cacheDirectory) && !std::filesystem::create_directories(cacheDirectory)) {
         return false;
     }
     if (!std::filesystem::is_directory(cacheDirectory)) {
         return false;
     }
-    std::vector<std::string> existingCache;
-    loadCache(existingCache);
-    std::unordered_set<std::string> existingSet(existingCache.begin(), existingCache.end());
-    
-    // Only write if there are new entries
-    std::vector<std::string> newEntries;
+
+    CacheWriteLock writeLock;
+    migrateLegacyCache();
+
+    // Existing entries stay mapped while the new file is assembled
+    IsoCacheView existingCache;
+    existingCache.open(cacheFilePath);
+
+    std::vector<CacheWriteEntry> combinedCache;
+    combinedCache.reserve(existingCache.size() + isoFiles.size());
+    std::unordered_map<std::string_view, size_t> existingIndex;
+    existingIndex.reserve(existingCache.size() + isoFiles.size());
+    for (size_t i = 0; i < existingCache.size(); ++i) {
+        if (existingIndex.emplace(existingCache[i], combinedCache.size()).second) {
+            combinedCache.push_back({existingCache[i], existingCache.record(i)});
+        }
+    }
+
+    // Append new entries and refresh metadata of known ones
+    bool modified = false;
     for (const auto& iso : isoFiles) {
-        if (existingSet.find(iso) == existingSet.end()) {
-            newEntries.push_back(iso);
+        IsoCacheRecord record = recordFromEntry(iso);
+        auto [it, inserted] = existingIndex.emplace(iso.path, combinedCache.size());
+        if (inserted) {
+            combinedCache.push_back({iso.path, record});
+            modified = true;
             newISOFound.store(true); // Set the atomic variable to true when a new ISO is found
+        } else if (record.ino != 0 && !sameMetadata(combinedCache[it->second].record, record)) {
+            combinedCache[it->second].record = record;
+            modified = true;
         }
     }
-    
-    if (newEntries.empty()) {
-        return true; // No new entries, don't modify cache
+
+    if (!modified) {
+        // No new entries, don't modify cache, the scan itself is still worth remembering
+        if (snapshots) {
+            commitDirSnapshots(*snapshots);
+        }
+        return true;
     }
-    
-    // Combine existing cache with new entries, respecting max size
-    std::vector<std::string> combinedCache = existingCache;
-    combinedCache.insert(combinedCache.end(), newEntries.begin(), newEntries.end());
+
+    // Respect max size by dropping the oldest entries
+    bool trimmed = false;
     if (combinedCache.size() > maxCacheSize) {
         combinedCache.erase(combinedCache.begin(), combinedCache.begin() + (combinedCache.size() - maxCacheSize));
+        trimmed = true;
     }
-    
-    int fd = open(cachePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
+
+    // Entries found by traverse existed when they were stat'ed, so the previous validation time still holds
+    if (!writeCacheFile(cacheFilePath, combinedCache, existingCache.validatedAt(), &existingCache)) {
         return false;
     }
-    if (flock(fd, LOCK_EX) == -1) {
-        close(fd);
+
+    // Snapshots are only valid while every ISO below them is cached, trimming breaks that
+    if (trimmed) {
+        unlink(dirSnapshotFilePath.c_str());
+    } else if (snapshots) {
+        commitDirSnapshots(*snapshots);
+    }
+    return true;
+}
+
+
+// Function to apply file system events to the cache file and, when it is in sync, to globalIsoFileList
+void applyCacheEvents(const std::vector<IsoCacheEntry>& added, const std::vector<std::string>& removedFiles, const std::vector<std::string>& removedDirs, std::atomic<bool>& newISOFound) {
+    if (added.empty() && removedFiles.empty() && removedDirs.empty()) {
+        return;
+    }
+
+    std::error_code ec;
+    if (!std::filesystem::exists(cacheDirectory, ec) && !std::filesystem::create_directories(cacheDirectory, ec)) {
+        return;
+    }
+
+    auto isUnderRemovedDir = [&removedDirs](std::string_view path) {
+        for (const auto& dir : removedDirs) {
+            if (path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/') {
+                return true;
+            }
+        }
         return false;
+    };
+
+    std::filesystem::file_time_type previousTime;
+    std::filesystem::file_time_type writtenTime;
+    std::vector<std::string> dropped;
+    std::vector<std::string> inserted;
+    bool trimmed = false;
+    {
+        CacheWriteLock writeLock;
+        migrateLegacyCache();
+
+        previousTime = std::filesystem::last_write_time(cacheFilePath, ec);
+        IsoCacheView existingCache;
+        existingCache.open(cacheFilePath);
+
+        std::unordered_set<std::string_view> removedSet(removedFiles.begin(), removedFiles.end());
+        std::vector<CacheWriteEntry> combinedCache;
+        combinedCache.reserve(existingCache.size() + added.size());
+        std::unordered_map<std::string_view, size_t> existingIndex;
+        existingIndex.reserve(existingCache.size() + added.size());
+
+        for (size_t i = 0; i < existingCache.size(); ++i) {
+            std::string_view path = existingCache[i];
+            if (removedSet.count(path) || isUnderRemovedDir(path)) {
+                dropped.emplace_back(path);
+                continue;
+            }
+            if (existingIndex.emplace(path, combinedCache.size()).second) {
+                combinedCache.push_back({path, existingCache.record(i)});
+            }
+        }
+
+        bool modified = !dropped.empty();
+        for (const auto& iso : added) {
+            IsoCacheRecord record = recordFromEntry(iso);
+            auto [it, isNew] = existingIndex.emplace(iso.path, combinedCache.size());
+            if (isNew) {
+                combinedCache.push_back({iso.path, record});
+                inserted.push_back(iso.path);
+                modified = true;
+            } else if (record.ino != 0 && !sameMetadata(combinedCache[it->second].record, record)) {
+                combinedCache[it->second].record = record;
+                modified = true;
+            }
+        }
+
+        if (!modified) {
+            return;
+        }
+
+        // Respect max size by dropping the oldest entries
+        if (combinedCache.size() > maxCacheSize) {
+            combinedCache.erase(combinedCache.begin(), combinedCache.begin() + (combinedCache.size() - maxCacheSize));
+            trimmed = true;
+        }
+
+        if (!writeCacheFile(cacheFilePath, combinedCache, existingCache.validatedAt(), &existingCache)) {
+            return;
+        }
+        if (trimmed) {
+            unlink(dirSnapshotFilePath.c_str());
+        }
+        writtenTime = std::filesystem::last_write_time(cacheFilePath, ec);
     }
-    
-    bool success = true;
-    for (const auto& entry : combinedCache) {
-        std::string line = entry + "\n";
-        if (write(fd, line.data(), line.size()) == -1) {
-            success = false;
-            break;
+
+    // Patch the in-memory list only if it reflects the cache we just modified, otherwise the
+    // next clearAndLoadFiles notices the new modification time and reloads it
+    if (!dropped.empty() || !inserted.empty()) {
+        std::lock_guard<std::mutex> lock(updateListMutex);
+        if (!trimmed && lastLoadedCacheTime != std::filesystem::file_time_type{} && lastLoadedCacheTime == previousTime) {
+            if (!dropped.empty()) {
+                std::unordered_set<std::string_view> droppedSet(dropped.begin(), dropped.end());
+                globalIsoListIndex.removeIf(globalIsoFileList,
+                    [&droppedSet](const std::string& path) { return droppedSet.count(path) > 0; });
+            }
+            globalIsoListIndex.insert(globalIsoFileList, inserted);
+            lastLoadedCacheTime = writtenTime;
         }
+        newISOFound.store(true);
     }
-    
-    flock(fd, LOCK_UN);
-    close(fd);
-    return success;
+}
+
+
+// Function to look up file sizes recorded in the ISO cache without touching the filesystem
+std::vector<std::optional<uint64_t>> getCachedFileSizes(const std::vector<std::string>& files) {
+    std::vector<std::optional<uint64_t>> sizes(files.size());
+
+    IsoCacheView cache;
+    if (files.empty() || !cache.open(cacheFilePath)) {
+        return sizes;
+    }
+
+    std::unordered_map<std::string_view, size_t> wanted;
+    wanted.reserve(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        wanted.emplace(files[i], i);
+    }
+
+    for (size_t i = 0; i < cache.size(); ++i) {
+        auto it = wanted.find(cache[i]);
+        if (it == wanted.end() || cache.record(i).ino == 0) {
+            continue;
+        }
+        sizes[it->second] = cache.record(i).size;
+    }
+
+    // Duplicate selections share the size of their first occurrence
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!sizes[i]) {
+            sizes[i] = sizes[wanted[files[i]]];
+        }
+    }
+
+    return sizes;
 }
 
 
@@ -480,9 +1212,13 @@ void cacheAndMiscSwitches(std::string& inputSearch, const bool& promptFlag, cons
             double fileSizeInMB = fileSizeInBytes / (1024.0 * 1024.0);
             double cachesizeInMb = cachesizeInBytes / (1024.0 * 1024.0);
 
+            // Entry count comes straight from the binary cache header
+            IsoCacheView cache;
+            size_t cacheEntries = cache.open(cacheFilePath) ? cache.size() : 0;
+
             std::cout << "\nCapacity: " << std::fixed << std::setprecision(1) << fileSizeInMB << "MB" 
                       << "/" << std::setprecision(0) << cachesizeInMb << "MB" 
-                      << " \nEntries: "<< countNonEmptyLines(cacheFilePath) 
+                      << " \nEntries: "<< cacheEntries 
                       << "\nLocation: " << "'" << cacheFilePath << "'\033[0;1m" << std::endl;
         } catch (const std::filesystem::filesystem_error& e) {
             std::cerr << "\n\033[1;91mError: " << e.what() << std::endl;
@@ -493,6 +1229,9 @@ void cacheAndMiscSwitches(std::string& inputSearch, const bool& promptFlag, cons
         manualRefreshCache(initialDir, promptFlag, maxDepth, historyPattern, newISOFound);
 
     } else if (inputSearch == "!clr") {
+        // Drop a pending legacy cache too, otherwise it would be migrated back on next load
+        std::remove(legacyCacheFilePath.c_str());
+        std::remove(dirSnapshotFilePath.c_str());
         if (std::remove(cacheFilePath.c_str()) != 0) {
             std::cerr << "\n\001\033[1;91mError clearing IsoCache: \001\033[1;93m'" 
                       << cacheFilePath << "\001'\033[1;91m. File missing or inaccessible." << std::endl;
@@ -640,8 +1379,10 @@ void manualRefreshCache(std::string& initialDir, bool promptFlag, int maxDepth,
     std::vector<std::string> validPaths;
     std::set<std::string> invalidPaths;
     std::set<std::string> uniqueErrorMessages;
-    std::vector<std::string> allIsoFiles;
+    std::vector<IsoCacheEntry> allIsoFiles;
     std::atomic<size_t> totalFiles{0};
+    DirSnapshotScan snapshots;
+    loadDirSnapshots(snapshots);
 	
 	if (promptFlag) {
 		disableInput();
@@ -650,15 +1391,12 @@ void manualRefreshCache(std::string& initialDir, bool promptFlag, int maxDepth,
     auto start_time = std::chrono::high_resolution_clock::now();
 
     // Single-pass path processing with concurrent file traversal
-    std::vector<std::future<void>> futures;
+    TaskGroup tasks(globalThreadPool(), &g_operationCancelled);
     std::mutex processMutex;
     std::mutex traverseErrorMutex;
 
     std::istringstream iss(input);
     std::string path;
-    std::size_t runningTasks = 0;
-	
-	
     
     while (std::getline(iss, path, ';')) {
         if (!isValidDirectory(path)) {
@@ -670,28 +1408,14 @@ void manualRefreshCache(std::string& initialDir, bool promptFlag, int maxDepth,
         }
 
         validPaths.push_back(path);
-        futures.emplace_back(std::async(std::launch::async, 
-            [path, &allIsoFiles, &uniqueErrorMessages, &totalFiles, &processMutex, &traverseErrorMutex, &maxDepth, &promptFlag]() {
-                traverse(path, allIsoFiles, uniqueErrorMessages, 
-                         totalFiles, processMutex, traverseErrorMutex, maxDepth, promptFlag);
-            }
-        ));
-
-        if (++runningTasks >= maxThreads) {
-            for (auto& future : futures) {
-                future.wait();
-                if (g_operationCancelled.load()) break;
-            }
-            futures.clear();
-            runningTasks = 0;
-        }
+        tasks.run([path, &allIsoFiles, &uniqueErrorMessages, &totalFiles, &processMutex, &traverseErrorMutex, &maxDepth, &promptFlag, &snapshots]() {
+            traverse(path, allIsoFiles, uniqueErrorMessages, 
+                     totalFiles, processMutex, traverseErrorMutex, maxDepth, promptFlag, snapshots, g_operationCancelled);
+        });
     }
 
-    // Wait for remaining tasks
-    for (auto& future : futures) {
-        future.wait();
-        if (g_operationCancelled.load()) break;
-    }
+    // Wait for all paths, the pool bounds how many are walked at once
+    tasks.wait();
     
     // Post-processing
     if (promptFlag) {
@@ -715,11 +1439,11 @@ void manualRefreshCache(std::string& initialDir, bool promptFlag, int maxDepth,
 			clear_history();
 		}
         verboseIsoCacheRefresh(allIsoFiles, totalFiles, validPaths, invalidPaths, 
-                               uniqueErrorMessages, promptFlag, maxDepth, historyPattern, start_time, newISOFound);
+                               uniqueErrorMessages, promptFlag, maxDepth, historyPattern, start_time, newISOFound, snapshots);
     } else {
 		if (!g_operationCancelled.load()) {
 			// Save the combined cache to disk
-			saveCache(allIsoFiles, maxCacheSize, newISOFound);
+			saveCache(allIsoFiles, maxCacheSize, newISOFound, &snapshots);
 		}
 		promptFlag = true;
 		maxDepth = -1;
@@ -728,75 +1452,130 @@ void manualRefreshCache(std::string& initialDir, bool promptFlag, int maxDepth,
 
 
 // Function to traverse a directory and find ISO files
-void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::atomic<size_t>& totalFiles, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag) {
-    const size_t BATCH_SIZE = 100;
-    std::vector<std::string> localIsoFiles;
-    
-    std::atomic<bool> g_CancelledMessageAdded{false};
-    // Reset cancellation flag
-    g_operationCancelled.store(false);
+void traverse(const std::filesystem::path& path, std::vector<IsoCacheEntry>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::atomic<size_t>& totalFiles, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag, DirSnapshotScan& snapshots, std::atomic<bool>& cancelled) {
+    // Count processed files, refreshing the display every 100 files
+    auto countFiles = [&](size_t count) {
+        if (!promptFlag || count == 0) return;
+        size_t before = totalFiles.fetch_add(count, std::memory_order_acq_rel);
+        if ((before + count) / 100 != before / 100) { // Update display periodically
+            std::lock_guard<std::mutex> lock(couNtMutex);
+            std::cout << "\r\033[0;1mTotal files processed: " << totalFiles << std::flush;
+        }
+    };
 
+    const int64_t scanStart = currentTimeNs();
+    const int64_t racyWindow = 2000000000LL;
+
+    DirectoryWalkVisitor visitor;
+
+    // Function to report an ISO with metadata captured here, so listing and validation can skip stat later
+    auto addIsoFile = [&](const std::string& dirPath, int dirFd, const char* name) {
+        IsoCacheEntry isoEntry;
+        isoEntry.path = dirPath == "/" ? dirPath + name : dirPath + "/" + name;
+        struct stat st;
+        if (fstatat(dirFd, name, &st, 0) == 0) {
+            isoEntry.size = static_cast<uint64_t>(st.st_size);
+            isoEntry.mtime = statTimeToNs(st.st_mtim);
+            isoEntry.ino = static_cast<uint64_t>(st.st_ino);
+            isoEntry.dev = static_cast<uint64_t>(st.st_dev);
+        }
+        std::lock_guard<std::mutex> lock(traverseFilesMutex);
+        isoFiles.push_back(std::move(isoEntry));
+    };
+
+    // Conversion candidates met on the way are handed to the Convert2ISO caches afterwards
+    std::mutex imageFilesMutex;
+    std::vector<std::string> binImgFiles, mdfFiles, nrgFiles;
 
-    auto iequals = [](const std::string_view& a, const std::string_view& b) {
-        return std::equal(a.begin(), a.end(), b.begin(), b.end(),
-                         [](unsigned char a, unsigned char b) {
-                             return std::tolower(a) == std::tolower(b);
-                         });
+    auto addConversionFile = [&](const std::string& dirPath, ImageFileType type, const char* name) {
+        std::string filePath = dirPath == "/" ? dirPath + name : dirPath + "/" + name;
+        std::lock_guard<std::mutex> lock(imageFilesMutex);
+        auto& files = type == ImageFileType::BinImg ? binImgFiles : (type == ImageFileType::Mdf ? mdfFiles : nrgFiles);
+        files.push_back(std::move(filePath));
     };
 
-    try {
-        auto options = std::filesystem::directory_options::none;
-        for (auto it = std::filesystem::recursive_directory_iterator(path, options); 
-			it != std::filesystem::recursive_directory_iterator(); ++it) {
-			if (g_operationCancelled.load()) {
-				if (!g_CancelledMessageAdded.exchange(true)) {
-					std::lock_guard<std::mutex> lock(globalSetsMutex);
-					uniqueErrorMessages.clear();
-					uniqueErrorMessages.insert("\n\033[1;33mISO search interrupted by user.\033[0;1m");
-				}
-				break;
-			}
-                if (maxDepth >= 0 && it.depth() > maxDepth) {
-                    it.disable_recursion_pending();
-                    continue;
-                }
+    // Image names of directories being read, moved into their snapshot once the read completes
+    std::mutex imagesMutex;
+    std::unordered_map<std::string, std::vector<DirSnapshotImage>> imagesByDir;
 
-                const auto& entry = *it;
-                if (promptFlag && entry.is_regular_file()) {
-                    totalFiles.fetch_add(1, std::memory_order_acq_rel);
-                    if (totalFiles % 100 == 0) { // Update display periodically
-						std::lock_guard<std::mutex> lock(couNtMutex);
-                        std::cout << "\r\033[0;1mTotal files processed: " << totalFiles << std::flush;
-                    }
-                }
+    // Unchanged directory: its entries are known, so its images are reported from the snapshot.
+    // ISOs rewritten in place keep the directory untouched, so they are stat'ed again
+    visitor.reuseDirectory = [&](const std::string& dirPath, int dirFd, const struct stat& dirStat, std::vector<std::string>& subdirs) {
+        auto previous = snapshots.previous.find(dirPath);
+        if (previous == snapshots.previous.end() || !previous->second.matches(dirStat)) {
+            return false;
+        }
+        countFiles(previous->second.fileCount);
+        for (const auto& image : previous->second.images) {
+            ImageFileType type = static_cast<ImageFileType>(image.type);
+            if (type == ImageFileType::Iso) {
+                addIsoFile(dirPath, dirFd, image.name.c_str());
+            } else if (type == ImageFileType::BinImg || type == ImageFileType::Mdf || type == ImageFileType::Nrg) {
+                addConversionFile(dirPath, type, image.name.c_str());
+            }
+        }
+        subdirs = previous->second.subdirs;
+        std::lock_guard<std::mutex> lock(snapshots.currentMutex);
+        snapshots.current.push_back(previous->second);
+        return true;
+    };
 
-                if (!entry.is_regular_file()) continue;
+    visitor.onFile = [&](const std::string& dirPath, int dirFd, const char* name) {
+        countFiles(1);
 
-                const auto& filePath = entry.path();
-                if (!iequals(filePath.extension().string(), ".iso")) continue;
+        ImageFileType type = classifyImageFile(name, std::strlen(name));
+        if (type == ImageFileType::Other) return;
 
-                localIsoFiles.push_back(filePath.string());
+        if (type == ImageFileType::Iso) {
+            addIsoFile(dirPath, dirFd, name);
+        } else {
+            addConversionFile(dirPath, type, name);
+        }
+        std::lock_guard<std::mutex> lock(imagesMutex);
+        imagesByDir[dirPath].push_back({static_cast<uint8_t>(type), name});
+    };
 
-                if (localIsoFiles.size() >= BATCH_SIZE) {
-                    std::lock_guard<std::mutex> lock(traverseFilesMutex);
-                    isoFiles.insert(isoFiles.end(), localIsoFiles.begin(), localIsoFiles.end());
-                    localIsoFiles.clear();
-                }
-			}
+    visitor.onDirectoryRead = [&](const std::string& dirPath, const struct stat& dirStat, std::vector<std::string>& subdirs, uint64_t fileCount) {
+        DirSnapshot snapshot;
+        snapshot.path = dirPath;
+        snapshot.mtime = statTimeToNs(dirStat.st_mtim);
+        snapshot.ctime = statTimeToNs(dirStat.st_ctim);
+        snapshot.ino = static_cast<uint64_t>(dirStat.st_ino);
+        snapshot.dev = static_cast<uint64_t>(dirStat.st_dev);
+        snapshot.fileCount = fileCount;
+        snapshot.subdirs = std::move(subdirs);
+        {
+            std::lock_guard<std::mutex> lock(imagesMutex);
+            auto images = imagesByDir.find(dirPath);
+            if (images != imagesByDir.end()) {
+                snapshot.images = std::move(images->second);
+                imagesByDir.erase(images);
+            }
+        }
 
-        // Merge leftovers
-        if (!localIsoFiles.empty()) {
-            std::lock_guard<std::mutex> lock(traverseFilesMutex);
-            isoFiles.insert(isoFiles.end(), localIsoFiles.begin(), localIsoFiles.end());
+        // Changes within the timestamp granularity of this read would go unnoticed, so a
+        // directory modified just now keeps its subdirectory list but is always re-read
+        if (snapshot.mtime >= scanStart - racyWindow || snapshot.ctime >= scanStart - racyWindow) {
+            snapshot.mtime = 0;
         }
+        std::lock_guard<std::mutex> lock(snapshots.currentMutex);
+        snapshots.current.push_back(std::move(snapshot));
+    };
 
-        // Merge errors
-    } catch (const std::filesystem::filesystem_error& e) {
-        std::string formattedError = "\n\033[1;91mError traversing directory: " + 
-                                    path.string() + " - " + e.what() + "\033[0;1m";
+    visitor.onError = [&](const std::string& dirPath, int error) {
         if (promptFlag) {
             std::lock_guard<std::mutex> errorLock(traverseErrorsMutex);
-            uniqueErrorMessages.insert(formattedError);
+            uniqueErrorMessages.insert("\n\033[1;91mError traversing directory: " + dirPath + " - " + std::strerror(error) + "\033[0;1m");
         }
+    };
+
+    walkDirectoryTree(path.string(), maxDepth, visitor, cancelled);
+
+    if (!cancelled.load()) {
+        addDiscoveredImageFiles(binImgFiles, mdfFiles, nrgFiles);
+    } else {
+        std::lock_guard<std::mutex> lock(globalSetsMutex);
+        uniqueErrorMessages.clear();
+        uniqueErrorMessages.insert("\n\033[1;33mISO search interrupted by user.\033[0;1m");
     }
 }
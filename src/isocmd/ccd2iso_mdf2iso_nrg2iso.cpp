@@ -1,8 +1,11 @@
 // SPDX-License-Identifier: GNU General Public License v2.0
 
 #include "../headers.h"
+#include "../threadpool.h"
+#include "../asyncio.h"
 #include "../mdf.h"
 #include "../ccd.h"
+#include "../nrg.h"
 
 
 // Special thanks to the original authors of the conversion tools:
@@ -14,303 +17,440 @@
 // Note: Their original code has been modernized and ported to C++.
 
 
-// MDF2ISO
+// BLOCK PIPELINE
 
-bool convertMdfToIso(const std::string& mdfPath, const std::string& isoPath, std::atomic<size_t>* completedBytes) {
-    namespace fs = std::filesystem;
-    std::ifstream mdfFile(mdfPath, std::ios::binary);
-    std::ofstream isoFile(isoPath, std::ios::binary);
-    if (!mdfFile.is_open() || !isoFile.is_open()) {
-        return false;
-    }
+// Sectors moved per block, a few MB per syscall keeps the disk busy instead of the kernel
+constexpr size_t CONVERSION_BLOCK_SECTORS = 2048;
 
-    // Disable internal buffering for more direct writes
-    isoFile.rdbuf()->pubsetbuf(nullptr, 0);
+// Blocks in flight per conversion stream, workers of a parallel conversion get fewer each
+constexpr size_t CONVERSION_QUEUE_DEPTH = 4;
+constexpr size_t CONVERSION_RANGE_QUEUE_DEPTH = 2;
 
-    size_t seek_ecc = 0, sector_size = 0, seek_head = 0, sector_data = 0;
-    char buf[12];
-    
-    // Check if file is valid MDF
-    mdfFile.seekg(32768);
-    if (!mdfFile.read(buf, 8) || std::memcmp("CD001", buf + 1, 5) == 0) {
-        return false; // Not an MDF file or unsupported format
-    }
-    
-    mdfFile.seekg(0);
-    if (!mdfFile.read(buf, 12)) {
-        return false;
+// Images above this size are split into sector ranges converted by several workers at once,
+// as many as the devices involved allow, so a spinning disk still sees a single stream
+constexpr uint64_t PARALLEL_CONVERSION_MIN_BYTES = 512ULL * 1024 * 1024;
+
+// Sectors per range, small enough to spread an image over every core, large enough to stay sequential
+constexpr uint64_t CONVERSION_RANGE_SECTORS = CONVERSION_BLOCK_SECTORS * 8;
+
+
+// Source and destination descriptors of one conversion, closed on every return
+struct ConversionFiles {
+    int in = -1;
+    int out = -1;
+    uint64_t inSize = 0;
+    dev_t inDev = 0;
+    dev_t outDev = 0;
+
+    ~ConversionFiles() {
+        if (in != -1) close(in);
+        if (out != -1) close(out);
     }
-    
-    // Determine MDF type based on sync patterns
-    if (std::memcmp("\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00", buf, 12) == 0) {
-        mdfFile.seekg(2352);
-        if (!mdfFile.read(buf, 12)) {
+
+    // Function to open the image for one front-to-back pass
+    bool openInput(const std::string& path) {
+        in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (in == -1 || fstat(in, &st) == -1) {
             return false;
         }
-        if (std::memcmp("\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00", buf, 12) == 0) {
-            seek_ecc = 288;
-            sector_size = 2352;
-            sector_data = 2048;
-            seek_head = 16;
-        } else {
-            seek_ecc = 384;
-            sector_size = 2448;
-            sector_data = 2048;
-            seek_head = 16;
-        }
-    } else {
-        seek_head = 0;
-        sector_size = 2448;
-        seek_ecc = 96;
-        sector_data = 2352;
+        inSize = static_cast<uint64_t>(st.st_size);
+        inDev = st.st_dev;
+        posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+        return true;
     }
-    
-    // Calculate the number of sectors
-    mdfFile.seekg(0, std::ios::end);
-    size_t source_length = static_cast<size_t>(mdfFile.tellg()) / sector_size;
-    mdfFile.seekg(0, std::ios::beg);
-    
-    // Buffer for a single sector
-    std::vector<char> sectorBuffer(sector_data);
-    size_t sectorsProcessed = 0;
-
-    while (source_length > 0) {
-        // Check cancellation at the start
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
-            return false;
-        }
 
-        // Skip header
-        mdfFile.seekg(static_cast<std::streamoff>(seek_head), std::ios::cur);
-        
-        // Check after seeking header
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
+    bool openOutput(const std::string& path) {
+        out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        struct stat st;
+        if (out == -1 || fstat(out, &st) == -1) {
             return false;
         }
-        
-        // Read sector data
-        if (!mdfFile.read(sectorBuffer.data(), sector_data)) {
-            return false;
+        outDev = st.st_dev;
+        return true;
+    }
+
+    // Function to close the finished output, late write errors surface here
+    bool closeOutput() {
+        int fd = out;
+        out = -1;
+        return close(fd) == 0;
+    }
+};
+
+
+// Function to read until len bytes at offset arrived or the file ended, returns the bytes read or -1
+static ssize_t preadFully(int fd, char* buf, size_t len, uint64_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t result = pread(fd, buf + total, len - total, static_cast<off_t>(offset + total));
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            return -1;
         }
-        
-        // Check after reading sector
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
-            return false;
+        if (result == 0) break;
+        total += static_cast<size_t>(result);
+    }
+    return static_cast<ssize_t>(total);
+}
+
+
+// Function to copy length bytes at srcOffset of the input to destOffset of the output without
+// the data passing through user space. A reflink shares the extents outright on btrfs and XFS,
+// copy_file_range lets the filesystem or the kernel move them, read/write is the last resort
+static bool copyRange(ConversionFiles& files, uint64_t srcOffset, uint64_t length, uint64_t destOffset, std::atomic<size_t>* completedBytes) {
+    if (length == 0) {
+        return true;
+    }
+
+    // Reflinks need block aligned ranges, the source end may be unaligned only at its EOF
+    struct file_clone_range clone{};
+    clone.src_fd = files.in;
+    clone.src_offset = srcOffset;
+    clone.src_length = length;
+    clone.dest_offset = destOffset;
+    if (ioctl(files.out, FICLONERANGE, &clone) == 0) {
+        if (completedBytes) {
+            completedBytes->fetch_add(length, std::memory_order_relaxed);
         }
-        
-        // Skip ECC data
-        mdfFile.seekg(static_cast<std::streamoff>(seek_ecc), std::ios::cur);
-        
-        // Check after seeking ECC
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
+        return true;
+    }
+
+    // Chunks keep cancellation and progress responsive on filesystems that really copy
+    constexpr uint64_t chunkSize = 64ULL * 1024 * 1024;
+    loff_t inOffset = static_cast<loff_t>(srcOffset);
+    loff_t outOffset = static_cast<loff_t>(destOffset);
+    uint64_t remaining = length;
+    while (remaining > 0) {
+        if (g_operationCancelled.load(std::memory_order_relaxed)) {
             return false;
         }
-        
-        // Write sector immediately
-        if (!isoFile.write(sectorBuffer.data(), sector_data)) {
+
+        ssize_t copied = copy_file_range(files.in, &inOffset, files.out, &outOffset, std::min(remaining, chunkSize), 0);
+        if (copied == -1) {
+            if (errno == EINTR) continue;
+            // Not supported for this pair of files, finish with plain reads and writes
+            if (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL) break;
             return false;
         }
-        
-        // Check after writing sector
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
-            return false;
+        if (copied == 0) {
+            return false; // Source shorter than expected
         }
-
-        // Update progress
+        remaining -= static_cast<uint64_t>(copied);
         if (completedBytes) {
-            completedBytes->fetch_add(sector_data, std::memory_order_relaxed);
+            completedBytes->fetch_add(static_cast<size_t>(copied), std::memory_order_relaxed);
         }
-        
-        sectorsProcessed++;
-        --source_length;
     }
 
-    return true;
+    if (remaining == 0) {
+        return true;
+    }
+
+    AsyncIoQueue queue(CONVERSION_QUEUE_DEPTH, CONVERSION_BLOCK_SECTORS * DATA_SIZE);
+    AsyncIoQueue::Stream stream;
+    stream.in = files.in;
+    stream.inOffset = static_cast<uint64_t>(inOffset);
+    stream.length = remaining;
+    stream.out = files.out;
+    stream.outOffset = static_cast<uint64_t>(outOffset);
+    return queue.run(stream, nullptr, [completedBytes](size_t bytes) {
+        if (completedBytes) {
+            completedBytes->fetch_add(bytes, std::memory_order_relaxed);
+        }
+    });
 }
 
 
-// CCD2ISO
+// Function to convert sectorCount raw sectors into payloadSize byte sectors. gather(raw, sectors, payload)
+// moves the payload of a block of sectors to the front of the block and returns how many it took, fewer
+// when it met a sector that ends the data. Every sector has a fixed place in both files, so large images are cut into ranges that
+// workers take in turn and read and write at their own offsets, each through its own queue. stopSector receives the
+// first sector gather refused, or sectorCount, and the output is cut back to the payload before it.
+template <typename Gather>
+static bool convertSectors(ConversionFiles& files, uint64_t sectorCount, size_t sectorSize, size_t payloadSize,
+                           Gather gather, uint64_t& stopSector, std::atomic<size_t>* completedBytes) {
+    std::atomic<uint64_t> firstRefused{sectorCount};
+    std::atomic<bool> failed{false};
 
-bool convertCcdToIso(const std::string& ccdPath, const std::string& isoPath, std::atomic<size_t>* completedBytes) {
-    namespace fs = std::filesystem;
-    std::ifstream ccdFile(ccdPath, std::ios::binary);
-    if (!ccdFile) return false;
-    
-    std::ofstream isoFile(isoPath, std::ios::binary);
-    if (!isoFile) return false;
-
-    // Disable internal buffering for more direct writes
-    isoFile.rdbuf()->pubsetbuf(nullptr, 0);
-    
-    CcdSector sector;
-    size_t sectorNum = 0;
-    
-    while (ccdFile.read(reinterpret_cast<char*>(&sector), sizeof(CcdSector))) {
-        // Check cancellation at the start of the loop
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
-            return false;
+    auto progress = [completedBytes](size_t bytes) {
+        // Update progress
+        if (completedBytes) {
+            completedBytes->fetch_add(bytes, std::memory_order_relaxed);
         }
+    };
+
+    auto convertRange = [&](AsyncIoQueue& queue, uint64_t first, uint64_t last) {
+        AsyncIoQueue::Stream stream;
+        stream.in = files.in;
+        stream.inOffset = first * sectorSize;
+        stream.length = (last - first) * sectorSize;
+        stream.out = files.out;
+        stream.outOffset = first * payloadSize;
+        stream.outStride = CONVERSION_BLOCK_SECTORS * payloadSize;
+
+        auto transform = [&](char* block, size_t length, uint64_t index, bool& stop) -> ssize_t {
+            if (failed.load(std::memory_order_relaxed)) {
+                return -1;
+            }
 
-        size_t bytesWritten = 0;
-        
-        switch (sector.sectheader.header.mode) {
-            case 1: {
-                isoFile.write(reinterpret_cast<char*>(sector.content.mode1.data), DATA_SIZE);
-                bytesWritten = DATA_SIZE;
-                break;
+            // Sectors behind a refused one never reach the output
+            const uint64_t sector = first + index * CONVERSION_BLOCK_SECTORS;
+            if (sector >= firstRefused.load(std::memory_order_relaxed)) {
+                stop = true;
+                return 0;
             }
-            case 2: {
-                isoFile.write(reinterpret_cast<char*>(sector.content.mode2.data), DATA_SIZE);
-                bytesWritten = DATA_SIZE;
-                break;
+
+            const size_t sectors = length / sectorSize;
+            const size_t gathered = gather(block, sectors, block);
+            if (gathered < sectors) {
+                uint64_t refused = sector + gathered;
+                uint64_t current = firstRefused.load(std::memory_order_relaxed);
+                while (refused < current && !firstRefused.compare_exchange_weak(current, refused, std::memory_order_relaxed)) {
+                }
+                stop = true;
             }
-            case 0xe2:
-                // Found session marker
-                return true;
-            default:
-                return false;
+            return static_cast<ssize_t>(gathered * payloadSize);
+        };
+
+        if (!queue.run(stream, transform, progress)) {
+            failed.store(true, std::memory_order_relaxed);
         }
+    };
+
+    // The caller already holds a slot on these devices, so extra workers only come from their spare cap
+    const uint64_t rangeCount = (sectorCount + CONVERSION_RANGE_SECTORS - 1) / CONVERSION_RANGE_SECTORS;
+    size_t workers = 1;
+    if (files.inSize >= PARALLEL_CONVERSION_MIN_BYTES) {
+        IoScheduler& io = globalThreadPool().ioScheduler();
+        workers = std::min({static_cast<size_t>(maxThreads), io.deviceLimit(files.inDev), io.deviceLimit(files.outDev)});
+        workers = static_cast<size_t>(std::min<uint64_t>(workers, rangeCount));
+    }
 
-        // Check cancellation immediately after writing sector data
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
-            return false;
+    if (workers < 2) {
+        AsyncIoQueue queue(CONVERSION_QUEUE_DEPTH, CONVERSION_BLOCK_SECTORS * sectorSize);
+        convertRange(queue, 0, sectorCount);
+    } else {
+        std::atomic<uint64_t> nextRange{0};
+        TaskGroup rangeWorkers(globalThreadPool(), &g_operationCancelled);
+        for (size_t w = 0; w < workers; ++w) {
+            rangeWorkers.run([&]() {
+                AsyncIoQueue queue(CONVERSION_RANGE_QUEUE_DEPTH, CONVERSION_BLOCK_SECTORS * sectorSize);
+                for (uint64_t range = nextRange.fetch_add(1); range < rangeCount && !failed.load(std::memory_order_relaxed);
+                     range = nextRange.fetch_add(1)) {
+                    const uint64_t first = range * CONVERSION_RANGE_SECTORS;
+                    if (first >= firstRefused.load(std::memory_order_relaxed)) {
+                        break;
+                    }
+                    convertRange(queue, first, std::min(sectorCount, first + CONVERSION_RANGE_SECTORS));
+                }
+            });
         }
+        rangeWorkers.wait();
+    }
+
+    if (failed.load() || g_operationCancelled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    // Blocks past the stop may already have written their payload
+    stopSector = firstRefused.load();
+    if (stopSector < sectorCount && ftruncate(files.out, static_cast<off_t>(stopSector * payloadSize)) == -1) {
+        return false;
+    }
+    return true;
+}
+
 
-        // Validate write operation
-        if (!isoFile || bytesWritten != DATA_SIZE) {
+// MDF2ISO
+
+bool convertMdfToIso(const std::string& mdfPath, const std::string& isoPath, std::atomic<size_t>* completedBytes) {
+    MdfTypeInfo type;
+    {
+        std::ifstream mdfFile(mdfPath, std::ios::binary);
+        if (!mdfFile.is_open()) {
             return false;
         }
 
-        // Update progress
-        if (completedBytes) {
-            completedBytes->fetch_add(bytesWritten, std::memory_order_relaxed);
+        // Check if file is valid MDF
+        char buf[8];
+        mdfFile.seekg(32768);
+        if (!mdfFile.read(buf, 8) || std::memcmp("CD001", buf + 1, 5) == 0) {
+            return false; // Not an MDF file or unsupported format
         }
 
-        // Check cancellation after updating progress
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(isoPath);
+        // Determine MDF type based on sync patterns
+        if (!type.determineMdfType(mdfFile)) {
             return false;
         }
-        
-        sectorNum++;
     }
 
-    return true;
-}
-
-// NRG2ISO
-
-bool convertNrgToIso(const std::string& inputFile, const std::string& outputFile, std::atomic<size_t>* completedBytes) {
-    namespace fs = std::filesystem;
-    std::ifstream nrgFile(inputFile, std::ios::binary);
-    if (!nrgFile) {
+    ConversionFiles files;
+    if (!files.openInput(mdfPath) || !files.openOutput(isoPath)) {
         return false;
     }
 
-    // Get the size of the input file
-    nrgFile.seekg(0, std::ios::end);
-    std::streamsize nrgFileSize = nrgFile.tellg();
-    nrgFile.seekg(0, std::ios::beg);
-
-    // Check if the file is already in ISO format
-    nrgFile.seekg(16 * 2048);
-    char isoBuf[8];
-    nrgFile.read(isoBuf, 8);
-    
-    if (memcmp(isoBuf, "\x01" "CD001" "\x01\x00", 8) == 0) {
-        return false;  // Already an ISO, no conversion needed
-    }
+    // Trailing bytes that do not fill a whole sector are ignored
+    const uint64_t sectorCount = files.inSize / type.sector_size;
 
-    // Reopen file for conversion
-    nrgFile.clear();
-    nrgFile.seekg(307200, std::ios::beg);  // Skip the header section
+    // Strided gather, skipping sync header and ECC of every sector
+    auto gather = [&type](const char* raw, size_t sectors, char* payload) {
+        const char* src = raw + type.seek_head;
+        for (size_t i = 0; i < sectors; ++i) {
+            std::memmove(payload, src, type.sector_data);
+            src += type.sector_size;
+            payload += type.sector_data;
+        }
+        return sectors;
+    };
 
-    std::ofstream isoFile(outputFile, std::ios::binary);
-    if (!isoFile) {
+    uint64_t stopSector;
+    if (!convertSectors(files, sectorCount, type.sector_size, type.sector_data, gather, stopSector, completedBytes)) {
         return false;
     }
 
-    // Disable internal buffering for more direct writes
-    isoFile.rdbuf()->pubsetbuf(nullptr, 0);
+    return files.closeOutput();
+}
 
-    // Use sector-sized buffer (typical CD sector size is 2048 bytes)
-    constexpr size_t SECTOR_SIZE = 2048;
-    std::vector<char> sectorBuffer(SECTOR_SIZE);
-    size_t sectorsProcessed = 0;
 
-    // Initialize completedBytes to 0 if provided
-    if (completedBytes) {
-        *completedBytes = 0;
+// CCD2ISO
+
+bool convertCcdToIso(const std::string& ccdPath, const std::string& isoPath, std::atomic<size_t>* completedBytes) {
+    ConversionFiles files;
+    if (!files.openInput(ccdPath) || !files.openOutput(isoPath)) {
+        return false;
     }
 
-    // Check cancellation before starting the loop
-    if (g_operationCancelled.load()) {
-        isoFile.close();
-        fs::remove(outputFile);
+    // Payload offsets inside a raw sector for both data modes
+    constexpr size_t mode1Offset = offsetof(CcdSector, content.mode1.data);
+    constexpr size_t mode2Offset = offsetof(CcdSector, content.mode2.data);
+    constexpr size_t modeOffset = offsetof(CcdSector, sectheader.header.mode);
+
+    // A trailing partial sector is ignored
+    const uint64_t sectorCount = files.inSize / sizeof(CcdSector);
+
+    // Gather the payload of every sector up to a session marker or a sector of unknown mode
+    auto gather = [](const char* raw, size_t sectors, char* payload) {
+        const char* sector = raw;
+        for (size_t i = 0; i < sectors; ++i, sector += sizeof(CcdSector), payload += DATA_SIZE) {
+            const uint8_t mode = static_cast<uint8_t>(sector[modeOffset]);
+            if (mode != 1 && mode != 2) {
+                return i;
+            }
+            std::memmove(payload, sector + (mode == 1 ? mode1Offset : mode2Offset), DATA_SIZE);
+        }
+        return sectors;
+    };
+
+    uint64_t stopSector;
+    if (!convertSectors(files, sectorCount, sizeof(CcdSector), DATA_SIZE, gather, stopSector, completedBytes)) {
         return false;
     }
 
-    // Read and write sector by sector
-    while (nrgFile && nrgFile.tellg() < nrgFileSize) {
-        // Check cancellation at the start of the loop
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(outputFile);
+    // The output ends cleanly only at a session marker
+    if (stopSector < sectorCount) {
+        char mode;
+        if (preadFully(files.in, &mode, 1, stopSector * sizeof(CcdSector) + modeOffset) != 1 ||
+            static_cast<uint8_t>(mode) != 0xe2) {
             return false;
         }
+    }
+
+    return files.closeOutput();
+}
+
+// NRG2ISO
+
+// Function to gather the 2048 byte payload of every raw sector of a track
+static bool extractNrgSectors(ConversionFiles& files, const NrgTrack& track, std::atomic<size_t>* completedBytes) {
+    AsyncIoQueue queue(CONVERSION_QUEUE_DEPTH, CONVERSION_BLOCK_SECTORS * track.sector_size);
+    AsyncIoQueue::Stream stream;
+    stream.in = files.in;
+    stream.inOffset = track.offset;
+    stream.length = track.length;
+    stream.out = files.out;
+    stream.outStride = CONVERSION_BLOCK_SECTORS * DATA_SIZE;
+
+    // 2336 byte sectors start with the Mode 2 subheader, full raw sectors name their mode after the sync
+    auto gather = [&track](char* block, size_t length, uint64_t, bool&) -> ssize_t {
+        const size_t sectors = length / track.sector_size;
+        const char* sector = block;
+        char* dst = block;
+        for (size_t i = 0; i < sectors; ++i, sector += track.sector_size, dst += DATA_SIZE) {
+            size_t head = 8;
+            if (track.sector_size != 2336) {
+                const uint8_t mode = static_cast<uint8_t>(sector[15]);
+                if (mode != 1 && mode != 2) {
+                    return -1;
+                }
+                head = mode == 1 ? 16 : 24;
+            }
+            std::memmove(dst, sector + head, DATA_SIZE);
+        }
+        return static_cast<ssize_t>(sectors * DATA_SIZE);
+    };
+
+    return queue.run(stream, gather, [completedBytes](size_t bytes) {
+        // Update progress
+        if (completedBytes) {
+            completedBytes->fetch_add(bytes, std::memory_order_relaxed);
+        }
+    });
+}
 
-        nrgFile.read(sectorBuffer.data(), SECTOR_SIZE);
-        std::streamsize bytesRead = nrgFile.gcount();
 
-        // Check cancellation after reading sector
-        if (g_operationCancelled.load()) {
-            isoFile.close();
-            fs::remove(outputFile);
+bool convertNrgToIso(const std::string& inputFile, const std::string& outputFile, std::atomic<size_t>* completedBytes) {
+    NrgImageInfo info;
+    {
+        std::ifstream nrgFile(inputFile, std::ios::binary);
+        if (!nrgFile.is_open()) {
             return false;
         }
-        
-        if (bytesRead > 0) {
-            if (!isoFile.write(sectorBuffer.data(), bytesRead)) {
-                return false;
-            }
 
-            // Check cancellation after writing sector
-            if (g_operationCancelled.load()) {
-                isoFile.close();
-                fs::remove(outputFile);
-                return false;
-            }
+        // Check if the file is already in ISO format
+        char isoBuf[8];
+        nrgFile.seekg(16 * 2048);
+        if (nrgFile.read(isoBuf, sizeof(isoBuf)) && memcmp(isoBuf, "\x01" "CD001" "\x01\x00", 8) == 0) {
+            return false;  // Already an ISO, no conversion needed
+        }
 
-            // Update progress
-            if (completedBytes) {
-                completedBytes->fetch_add(bytesRead, std::memory_order_relaxed);
-            }
+        info.parseNrgLayout(nrgFile);
+    }
 
-            // Check cancellation after updating progress
-            if (g_operationCancelled.load()) {
-                isoFile.close();
-                fs::remove(outputFile);
-                return false;
-            }
-            
-            sectorsProcessed++;
+    ConversionFiles files;
+    if (!files.openInput(inputFile)) {
+        return false;
+    }
+
+    // Images without a readable footer keep the classic layout: 2048 byte sectors behind a 300 KB lead-in
+    NrgTrack track;
+    if (!info.tracks.empty()) {
+        const NrgTrack* dataTrack = info.dataTrack();
+        if (!dataTrack) {
+            return false;  // Audio only
         }
+        track = *dataTrack;
+    } else {
+        track.offset = 307200;
+        track.length = files.inSize > track.offset ? files.inSize - track.offset : 0;
+        track.sector_size = DATA_SIZE;
     }
 
-    return true;
+    if (!files.openOutput(outputFile)) {
+        return false;
+    }
+
+    // Initialize completedBytes to 0 if provided
+    if (completedBytes) {
+        *completedBytes = 0;
+    }
+
+    // Cooked tracks are plain ISO data and handed over whole, raw ones are gathered sector by sector
+    bool copied = track.sector_size == DATA_SIZE
+        ? copyRange(files, track.offset, track.length, 0, completedBytes)
+        : extractNrgSectors(files, track, completedBytes);
+    if (!copied) {
+        return false;
+    }
+
+    return files.closeOutput();
 }
@@ -1,16 +1,62 @@
 // SPDX-License-Identifier: GNU General Public License v2.0
 
 #include "../headers.h"
+#include "../cache.h"
 #include "../threadpool.h"
 #include "../display.h"
 #include "../mdf.h"
 #include "../ccd.h"
+#include "../nrg.h"
+#include "../walker.h"
 
 
 static std::vector<std::string> binImgFilesCache; // Memory cached binImgFiles here
 static std::vector<std::string> mdfMdsFilesCache; // Memory cached mdfImgFiles here
 static std::vector<std::string> nrgFilesCache; // Memory cached nrgImgFiles here
 
+// Files found by walks for another file type, merged into the caches above by the menu thread
+static std::mutex discoveredFilesMutex;
+static std::vector<std::string> discoveredBinImgFiles;
+static std::vector<std::string> discoveredMdfFiles;
+static std::vector<std::string> discoveredNrgFiles;
+
+
+// Function to queue conversion candidates found while walking for something else
+void addDiscoveredImageFiles(const std::vector<std::string>& binImgFiles, const std::vector<std::string>& mdfFiles, const std::vector<std::string>& nrgFiles) {
+    if (binImgFiles.empty() && mdfFiles.empty() && nrgFiles.empty()) return;
+
+    std::lock_guard<std::mutex> lock(discoveredFilesMutex);
+    discoveredBinImgFiles.insert(discoveredBinImgFiles.end(), binImgFiles.begin(), binImgFiles.end());
+    discoveredMdfFiles.insert(discoveredMdfFiles.end(), mdfFiles.begin(), mdfFiles.end());
+    discoveredNrgFiles.insert(discoveredNrgFiles.end(), nrgFiles.begin(), nrgFiles.end());
+}
+
+
+// Function to move queued conversion candidates into the RAM caches, skipping known entries
+static void mergeDiscoveredImageFiles() {
+    std::vector<std::string> binImgFiles, mdfFiles, nrgFiles;
+    {
+        std::lock_guard<std::mutex> lock(discoveredFilesMutex);
+        binImgFiles.swap(discoveredBinImgFiles);
+        mdfFiles.swap(discoveredMdfFiles);
+        nrgFiles.swap(discoveredNrgFiles);
+    }
+
+    auto merge = [](std::vector<std::string>& cache, std::vector<std::string>& found) {
+        if (found.empty()) return;
+        std::unordered_set<std::string> known(cache.begin(), cache.end());
+        for (auto& file : found) {
+            if (known.insert(file).second) {
+                cache.push_back(std::move(file));
+            }
+        }
+    };
+
+    merge(binImgFilesCache, binImgFiles);
+    merge(mdfMdsFilesCache, mdfFiles);
+    merge(nrgFilesCache, nrgFiles);
+}
+
 // Function to clear Ram Cache and memory transformations for bin/img mdf nrg files
 void clearRamCache(bool& modeMdf, bool& modeNrg) {
 	signal(SIGINT, SIG_IGN);        // Ignore Ctrl+C
@@ -124,6 +170,7 @@ void promptSearchBinImgMdfNrg(const std::string& fileTypeChoice, bool& promptFla
         files.clear();
         fileNames.clear();
         processedErrorsFind.clear();
+        mergeDiscoveredImageFiles();
 		
 		clearScrollBuffer();
 
@@ -249,7 +296,8 @@ void promptSearchBinImgMdfNrg(const std::string& fileTypeChoice, bool& promptFla
 				},
 				directoryPaths,
 				invalidDirectoryPaths, 
-				processedErrorsFind 
+				processedErrorsFind,
+				newISOFound
 			);
 		}
 		
@@ -500,15 +548,24 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
 		for (const auto& file : filesToProcess) {
 			std::ifstream nrgFile(file, std::ios::binary);
 			if (nrgFile) {
+				// The output holds 2048 bytes per sector of the data track
+				NrgImageInfo nrgInfo;
+				if (nrgInfo.parseNrgLayout(nrgFile)) {
+					if (const NrgTrack* track = nrgInfo.dataTrack()) {
+						totalBytes += (track->length / track->sector_size) * DATA_SIZE;
+					}
+					continue;
+				}
+
 				// Seek to the end of the file to get the total size
+				nrgFile.clear();
 				nrgFile.seekg(0, std::ios::end);
 				size_t nrgFileSize = nrgFile.tellg();
 
-				// The ISO data starts after the 307,200-byte header
-				size_t isoDataSize = nrgFileSize - 307200;
-
-				// Add the ISO data size to the total bytes
-				totalBytes += isoDataSize;
+				// Without a footer the ISO data starts after the 307,200-byte header
+				if (nrgFileSize > 307200) {
+					totalBytes += nrgFileSize - 307200;
+				}
 			}
 		}
 	} else if (modeMdf) {
@@ -544,9 +601,7 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
     std::thread progressThread(displayProgressBarWithSize, &completedBytes, 
         totalBytes, &completedTasks, &failedTasks, totalTasks, &isProcessingComplete, &verbose);
 
-    ThreadPool pool(numThreads);
-    std::vector<std::future<void>> futures;
-    futures.reserve(indexChunks.size());
+    TaskGroup tasks(globalThreadPool(), &g_operationCancelled);
 
     for (const auto& chunk : indexChunks) {
         std::vector<std::string> imageFilesInChunk;
@@ -558,7 +613,10 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
             [&fileList](size_t index) { return fileList[index - 1]; }
         );
 
-        futures.emplace_back(pool.enqueue([imageFilesInChunk = std::move(imageFilesInChunk), 
+        // Output is written next to the source image, so the source devices cover both sides
+        std::vector<dev_t> devices = devicesOfPaths(imageFilesInChunk);
+
+        tasks.runOnDevices(std::move(devices), [imageFilesInChunk = std::move(imageFilesInChunk), 
             &fileList, &successOuts, &skippedOuts, &failedOuts, &deletedOuts, 
             modeMdf, modeNrg, &maxDepth, &promptFlag, &historyPattern, 
             &completedBytes, &completedTasks, &failedTasks, &newISOFound]() {
@@ -566,13 +624,10 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
             convertToISO(imageFilesInChunk, successOuts, skippedOuts, failedOuts, 
                 deletedOuts, modeMdf, modeNrg, maxDepth, promptFlag, historyPattern, 
                 &completedBytes, &completedTasks, &failedTasks, newISOFound);
-        }));
+        });
     }
 
-    for (auto& future : futures) {
-        future.wait();
-        if (g_operationCancelled.load()) break;
-    }
+    tasks.wait();
 
     isProcessingComplete.store(true);
     progressThread.join();
@@ -580,7 +635,7 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
 
 
 // Function to process a single batch of paths and find files for findFiles
-std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind) {
+std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind, std::atomic<bool>& newISOFound) {
     std::mutex fileNamesMutex;
     std::atomic<size_t> totalFiles{0};
     std::set<std::string> localFileNames;
@@ -590,65 +645,89 @@ std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPat
     
     disableInput();
 
-    for (const auto& path : batchPaths) {
-		
-        try {
-            // Flags for blacklisting
-            bool blacklistMdf = (mode == "mdf");
-            bool blacklistNrg = (mode == "nrg");
-
-            // Traverse directory
-            for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
-				if (g_operationCancelled.load()) {
-					if (!g_CancelledMessageAdded.exchange(true)) {
-						std::lock_guard<std::mutex> lock(globalSetsMutex);
-						processedErrorsFind.clear();
-						localFileNames.clear();
-						std::string type = (blacklistMdf) ? "MDF" : (blacklistNrg) ? "NRG" : "BIN/IMG";
-						processedErrorsFind.insert("\033[1;33m" + type + " search interrupted by user.\n\n\033[0;1m");
-					}
-					break;
-				}
-                if (entry.is_regular_file()) {
-                    totalFiles.fetch_add(1, std::memory_order_acq_rel);
-                    if (totalFiles % 100 == 0) { // Update display periodically
-						std::lock_guard<std::mutex> lock(couNtMutex);
-                        std::cout << "\r\033[0;1mTotal files processed: " << totalFiles << std::flush;
-                    }
-                    
-                    if (blacklist(entry, blacklistMdf, blacklistNrg)) {
-                        std::string fileName = entry.path().string();
-                        // Thread-safe insertion
-                        {
-                            std::lock_guard<std::mutex> lock(fileNamesMutex);
-                            bool isInCache = false;
-                            if (mode == "nrg") {
-                                isInCache = (std::find(nrgFilesCache.begin(), nrgFilesCache.end(), fileName) != nrgFilesCache.end());
-                            } else if (mode == "mdf") {
-                                isInCache = (std::find(mdfMdsFilesCache.begin(), mdfMdsFilesCache.end(), fileName) != mdfMdsFilesCache.end());
-                            } else if (mode == "bin") {
-                                isInCache = (std::find(binImgFilesCache.begin(), binImgFilesCache.end(), fileName) != binImgFilesCache.end());
-                            }
-                            
-                            if (!isInCache) {
-                                if (localFileNames.insert(fileName).second) {
-                                    callback(fileName, entry.path().parent_path().string());
-                                }
-                            }
-                        }
-                    }
-                }
+    // Type this search is for, other conversion types and ISOs are kept for their own menus
+    ImageFileType wanted = (mode == "mdf") ? ImageFileType::Mdf : (mode == "nrg") ? ImageFileType::Nrg : ImageFileType::BinImg;
+    std::vector<std::string> binImgFiles, mdfFiles, nrgFiles;
+    std::vector<IsoCacheEntry> isoFiles;
+
+    DirectoryWalkVisitor visitor;
+
+    visitor.onFile = [&](const std::string& dirPath, int dirFd, const char* name) {
+        size_t count = totalFiles.fetch_add(1, std::memory_order_acq_rel) + 1;
+        if (count % 100 == 0) { // Update display periodically
+            std::lock_guard<std::mutex> lock(couNtMutex);
+            std::cout << "\r\033[0;1mTotal files processed: " << count << std::flush;
+        }
+
+        ImageFileType type = classifyImageFile(name, std::strlen(name));
+        if (type == ImageFileType::Other) return;
+
+        std::string fileName = dirPath == "/" ? dirPath + name : dirPath + "/" + name;
+
+        // Thread-safe insertion
+        std::lock_guard<std::mutex> lock(fileNamesMutex);
+        if (type == ImageFileType::Iso) {
+            IsoCacheEntry isoEntry;
+            isoEntry.path = std::move(fileName);
+            struct stat st;
+            if (fstatat(dirFd, name, &st, 0) == 0) {
+                isoEntry.size = static_cast<uint64_t>(st.st_size);
+                isoEntry.mtime = statTimeToNs(st.st_mtim);
+                isoEntry.ino = static_cast<uint64_t>(st.st_ino);
+                isoEntry.dev = static_cast<uint64_t>(st.st_dev);
             }
+            isoFiles.push_back(std::move(isoEntry));
+            return;
+        }
+        if (type != wanted) {
+            auto& files = type == ImageFileType::BinImg ? binImgFiles : (type == ImageFileType::Mdf ? mdfFiles : nrgFiles);
+            files.push_back(std::move(fileName));
+            return;
+        }
 
-            
-        } catch (const std::filesystem::filesystem_error& e) {
-			std::lock_guard<std::mutex> lock(globalSetsMutex);
-            std::string errorMessage = "\033[1;91mError traversing path: " 
-                + path + " - " + e.what() + "\033[0;1m";
-            processedErrorsFind.insert(errorMessage);
+        bool isInCache = false;
+        if (mode == "nrg") {
+            isInCache = (std::find(nrgFilesCache.begin(), nrgFilesCache.end(), fileName) != nrgFilesCache.end());
+        } else if (mode == "mdf") {
+            isInCache = (std::find(mdfMdsFilesCache.begin(), mdfMdsFilesCache.end(), fileName) != mdfMdsFilesCache.end());
+        } else if (mode == "bin") {
+            isInCache = (std::find(binImgFilesCache.begin(), binImgFilesCache.end(), fileName) != binImgFilesCache.end());
+        }
+
+        if (!isInCache) {
+            if (localFileNames.insert(fileName).second) {
+                callback(fileName, dirPath);
+            }
+        }
+    };
+
+    visitor.onError = [&](const std::string& dirPath, int error) {
+        std::lock_guard<std::mutex> lock(globalSetsMutex);
+        std::string errorMessage = "\033[1;91mError traversing path: "
+            + dirPath + " - " + std::strerror(error) + "\033[0;1m";
+        processedErrorsFind.insert(errorMessage);
+    };
+
+    for (const auto& path : batchPaths) {
+        walkDirectoryTree(path, -1, visitor);
+
+        if (g_operationCancelled.load()) {
+            if (!g_CancelledMessageAdded.exchange(true)) {
+                std::lock_guard<std::mutex> lock(globalSetsMutex);
+                processedErrorsFind.clear();
+                localFileNames.clear();
+                std::string type = (wanted == ImageFileType::Mdf) ? "MDF" : (wanted == ImageFileType::Nrg) ? "NRG" : "BIN/IMG";
+                processedErrorsFind.insert("\033[1;33m" + type + " search interrupted by user.\n\n\033[0;1m");
+            }
+            break;
         }
     }
-	
+
+    if (!g_operationCancelled.load()) {
+        addDiscoveredImageFiles(binImgFiles, mdfFiles, nrgFiles);
+        applyCacheEvents(isoFiles, {}, {}, newISOFound);
+    }
+
 	{
 		std::lock_guard<std::mutex> lock(couNtMutex);
 		// Print the total files processed after all paths are handled
@@ -660,7 +739,7 @@ std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPat
 
 
 // Function to search for .bin .img .nrg and mdf files
-std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, std::set<std::string>& fileNames, int& currentCacheOld, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback, const std::vector<std::string>& directoryPaths, std::set<std::string>& invalidDirectoryPaths, std::set<std::string>& processedErrorsFind) {
+std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, std::set<std::string>& fileNames, int& currentCacheOld, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback, const std::vector<std::string>& directoryPaths, std::set<std::string>& invalidDirectoryPaths, std::set<std::string>& processedErrorsFind, std::atomic<bool>& newISOFound) {
 	
 	// Setup signal handler at the start of the operation
     setupSignalHandlerCancellations();
@@ -684,7 +763,6 @@ std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, s
     
     // Batch processing configuration
     const size_t BATCH_SIZE = 100;  // Number of paths per batch
-    const size_t MAX_CONCURRENT_BATCHES = maxThreads;
 
     // Prepare batches of input paths
     std::vector<std::vector<std::string>> pathBatches;
@@ -715,27 +793,21 @@ std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, s
         pathBatches.push_back(currentBatch);
     }
 
-    // Batch processing with thread pool
-    std::vector<std::future<std::set<std::string>>> batchFutures;
-    
-    // Process batches with thread pool
-    for (const auto& batch : pathBatches) {
-        batchFutures.push_back(std::async(std::launch::async, processBatchPaths, batch, mode, callback, std::ref(processedErrorsFind)));
-
-        // Limit concurrent batches
-        if (batchFutures.size() >= MAX_CONCURRENT_BATCHES) {
-            for (auto& future : batchFutures) {
-                future.wait();
-                if (g_operationCancelled.load()) break;
-            }
-            batchFutures.clear();
+    // Batch processing on the shared pool, each batch keeps its own results
+    std::vector<std::set<std::string>> batchResults(pathBatches.size());
+    {
+        TaskGroup tasks(globalThreadPool(), &g_operationCancelled);
+        for (size_t i = 0; i < pathBatches.size(); ++i) {
+            tasks.run([&, i]() {
+                batchResults[i] = processBatchPaths(pathBatches[i], mode, callback, processedErrorsFind, newISOFound);
+            });
         }
+        tasks.wait();
     }
 
     // Collect results from all batches
-    for (auto& future : batchFutures) {
-        std::set<std::string> batchResults = future.get();
-        fileNames.insert(batchResults.begin(), batchResults.end());
+    for (const auto& results : batchResults) {
+        fileNames.insert(results.begin(), results.end());
     }
 
     // Update invalid directory paths
@@ -792,51 +864,6 @@ std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, s
 }
 
 
-// Blacklist function for MDF BIN IMG NRG
-bool blacklist(const std::filesystem::path& entry, const bool& blacklistMdf, const bool& blacklistNrg) {
-    const std::string filenameLower = entry.filename().string();
-    const std::string ext = entry.extension().string();
-    std::string extLower = ext;
-    toLowerInPlace(extLower);
-
-    // Default mode: .bin and .img files
-    if (!blacklistMdf && !blacklistNrg) {
-        if (!((extLower == ".bin" || extLower == ".img"))) {
-            return false;
-        }
-    } 
-    // MDF mode
-    else if (blacklistMdf) {
-        if (extLower != ".mdf") {
-            return false;
-        }
-    } 
-    // NRG mode
-    else if (blacklistNrg) {
-        if (extLower != ".nrg") {
-            return false;
-        }
-    }
-
-
-    // Blacklisted keywords (previously commented out)
-    std::set<std::string> blacklistKeywords = {};
-    
-    // Convert filename to lowercase without extension
-    std::string filenameLowerNoExt = filenameLower;
-    filenameLowerNoExt.erase(filenameLowerNoExt.size() - ext.size());
-
-    // Check blacklisted keywords
-    for (const auto& keyword : blacklistKeywords) {
-        if (filenameLowerNoExt.find(keyword) != std::string::npos) {
-            return false;
-        }
-    }
-
-    return true;
-}
-
-
 // Function to convert a BIN/IMG/MDF/NRG file to ISO format
 void convertToISO(const std::vector<std::string>& imageFiles, std::set<std::string>& successOuts, std::set<std::string>& skippedOuts, std::set<std::string>& failedOuts, std::set<std::string>& deletedOuts, const bool& modeMdf, const bool& modeNrg, int& maxDepth, bool& promptFlag, bool& historyPattern, std::atomic<size_t>* completedBytes, std::atomic<size_t>* completedTasks, std::atomic<size_t>* failedTasks, std::atomic<bool>& newISOFound) {
 
@@ -2,6 +2,7 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../asyncio.h"
 
 
 // Function to process selected indices for cpMvDel accordingly
@@ -80,9 +81,18 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
     std::thread progressThread(displayProgressBarWithSize, &completedBytes, 
         totalBytes, &completedTasks, &failedTasks, totalTasks, &isProcessingComplete, &verbose);
 
-    ThreadPool pool(numThreads);
-    std::vector<std::future<void>> futures;
-    futures.reserve(indexChunks.size());
+    TaskGroup tasks(globalThreadPool(), &g_operationCancelled);
+
+    // Destination folders count against their devices for every chunk
+    std::vector<std::string> destDirs;
+    if (isCopy || isMove) {
+        std::istringstream destStream(userDestDir);
+        std::string destDir;
+        while (std::getline(destStream, destDir, ';')) {
+            destDirs.push_back(destDir);
+        }
+    }
+    const std::vector<dev_t> destDevices = devicesOfPaths(destDirs);
 
     for (const auto& chunk : indexChunks) {
         std::vector<std::string> isoFilesInChunk;
@@ -94,19 +104,19 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
             [&isoFiles](size_t index) { return isoFiles[index - 1]; }
         );
 
-        futures.emplace_back(pool.enqueue([isoFilesInChunk = std::move(isoFilesInChunk), 
+        std::vector<dev_t> devices = devicesOfPaths(isoFilesInChunk);
+        devices.insert(devices.end(), destDevices.begin(), destDevices.end());
+
+        tasks.runOnDevices(std::move(devices), [isoFilesInChunk = std::move(isoFilesInChunk), 
             &isoFiles, &operationIsos, &operationErrors, &userDestDir, 
             isMove, isCopy, isDelete, &completedBytes, &completedTasks, &failedTasks, &overwriteExisting]() {
             handleIsoFileOperation(isoFilesInChunk, isoFiles, operationIsos, 
                 operationErrors, userDestDir, isMove, isCopy, isDelete, 
                 &completedBytes, &completedTasks, &failedTasks, overwriteExisting);
-        }));
+        });
     }
 
-    for (auto& future : futures) {
-        future.wait();
-        if (g_operationCancelled.load()) break;
-    }
+    tasks.wait();
 
     isProcessingComplete.store(true);
     progressThread.join();
@@ -371,46 +381,50 @@ namespace fs = std::filesystem;
 
 // Function to buffer file copying
 bool bufferedCopyWithProgress(const fs::path& src, const fs::path& dst, std::atomic<size_t>* completedBytes, std::error_code& ec) {
-    const size_t bufferSize = 8 * 1024 * 1024; // 8MB buffer
-    std::vector<char> buffer(bufferSize);
-    
-    std::ifstream input(src, std::ios::binary);
-    if (!input) {
+    const size_t blockSize = 2 * 1024 * 1024; // 4 x 2MB blocks in flight
+    const size_t queueDepth = 4;
+
+    int input = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (input == -1 || fstat(input, &st) == -1) {
+        if (input != -1) close(input);
         ec = std::make_error_code(std::errc::no_such_file_or_directory);
         return false;
     }
-    
-    std::ofstream output(dst, std::ios::binary);
-    if (!output) {
+    posix_fadvise(input, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int output = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (output == -1) {
+        close(input);
         ec = std::make_error_code(std::errc::permission_denied);
         return false;
     }
-    
-    while (!g_operationCancelled.load()) { // Check cancellation flag at each iteration
-        input.read(buffer.data(), buffer.size());
-        std::streamsize bytesRead = input.gcount();
-        
-        if (bytesRead == 0) {
-            break;
-        }
-        
-        output.write(buffer.data(), bytesRead);
-        if (!output) {
-            ec = std::make_error_code(std::errc::io_error);
-            return false;
-        }
-        
-        completedBytes->fetch_add(bytesRead, std::memory_order_relaxed);
-    }
+
+    AsyncIoQueue queue(queueDepth, blockSize);
+    AsyncIoQueue::Stream stream;
+    stream.in = input;
+    stream.length = static_cast<uint64_t>(st.st_size);
+    stream.out = output;
+
+    bool copied = queue.run(stream, nullptr, [completedBytes](size_t bytes) {
+        completedBytes->fetch_add(bytes, std::memory_order_relaxed);
+    });
+    close(input);
+    copied = close(output) == 0 && copied;
 
     // Check if the operation was cancelled
     if (g_operationCancelled.load()) {
         ec = std::make_error_code(std::errc::operation_canceled);
-        output.close(); // Close the output stream before attempting to delete
-        fs::remove(dst, ec); // Delete the partial file, ignore errors here
+        std::error_code removeEc;
+        fs::remove(dst, removeEc); // Delete the partial file, ignore errors here
         return false;
     }
-    
+
+    if (!copied) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+
     return true;
 }
 
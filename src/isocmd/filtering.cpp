@@ -2,6 +2,8 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../filter.h"
+#include "../isolist.h"
 
 
 // Conver strings to lowercase efficiently
@@ -11,82 +13,6 @@ void toLowerInPlace(std::string& str) {
     }
 }
 
-// Boyer-Moore string search implementation for files
-std::vector<size_t> boyerMooreSearch(const std::string& pattern, const std::string& text) {
-    const size_t patternLen = pattern.length();
-    const size_t textLen = text.length();
-    
-    // Early exit conditions
-    if (patternLen == 0 || textLen == 0 || patternLen > textLen) 
-        return {};
-    
-    // Single character optimization
-    if (patternLen == 1) {
-        std::vector<size_t> matches;
-        for (size_t i = 0; i < textLen; ++i) 
-            if (text[i] == pattern[0]) 
-                matches.push_back(i);
-        return matches;
-    }
-    
-    // Preprocess bad character shifts
-    std::vector<size_t> badCharShifts(256, patternLen);
-    for (size_t i = 0; i < patternLen - 1; ++i) 
-        badCharShifts[static_cast<unsigned char>(pattern[i])] = patternLen - i - 1;
-    
-    // Preprocess good suffix shifts
-    std::vector<size_t> goodSuffixShifts(patternLen, patternLen);
-    std::vector<size_t> suffixLengths(patternLen, 0);
-    
-    // Compute suffix lengths and good suffix shifts
-    suffixLengths[patternLen - 1] = patternLen;
-    size_t lastPrefixPosition = patternLen;
-    
-    for (int i = patternLen - 2; i >= 0; --i) {
-        if (memcmp(pattern.c_str() + i + 1, pattern.c_str() + patternLen - lastPrefixPosition, lastPrefixPosition - (i + 1)) == 0) {
-            suffixLengths[i] = lastPrefixPosition - (i + 1);
-            lastPrefixPosition = i + 1;
-        }
-    }
-    
-    // Update good suffix shifts
-    for (size_t i = 0; i < patternLen; ++i) {
-        if (suffixLengths[i] == i + 1) {
-            for (size_t j = 0; j < patternLen - i - 1; ++j) 
-                if (goodSuffixShifts[j] == patternLen) 
-                    goodSuffixShifts[j] = patternLen - i - 1;
-        }
-        
-        if (suffixLengths[i] > 0) 
-            goodSuffixShifts[patternLen - suffixLengths[i]] = patternLen - i - 1;
-    }
-    
-    // Search phase
-    std::vector<size_t> matches;
-    for (size_t i = 0; i <= textLen - patternLen;) {
-        size_t skip = 0;
-        while (skip < patternLen && pattern[patternLen - 1 - skip] == text[i + patternLen - 1 - skip]) 
-            ++skip;
-        
-        // Pattern found
-        if (skip == patternLen) 
-            matches.push_back(i);
-        
-        // Compute shift
-        size_t badCharShift = (i + patternLen < textLen) 
-            ? badCharShifts[static_cast<unsigned char>(text[i + patternLen - 1])] 
-            : 1;
-        
-        size_t goodSuffixShift = goodSuffixShifts[skip];
-        
-        // Take the maximum shift
-        i += std::max(1ul, std::min(badCharShift, goodSuffixShift));
-    }
-    
-    return matches;
-}
-
-
 // Remove AnsiCodes from filenames
 std::string removeAnsiCodes(const std::string& input) {
     std::string result;
@@ -104,72 +30,159 @@ std::string removeAnsiCodes(const std::string& input) {
 }
 
 
-// Function to filter cached ISO files or mountpoints based on search query (case-insensitive)
-std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query) {
-    std::vector<std::string> filteredFiles;
-    std::set<std::string> queryTokens;
-
-    // Tokenize the query and convert each token to lowercase
-    std::stringstream ss(query);
-    std::string token;
-    
-    while (std::getline(ss, token, ';')) {
-        toLowerInPlace(token);
-        queryTokens.insert(token);
+// Function to run body(begin, end, batch) over [0, count) in batches on the pool, short ranges
+// run inline as one batch because handing them to the pool costs more than the work.
+// Returns the number of batches so callers can size per-batch state up front
+static size_t batchCount(size_t count, size_t& batchSize) {
+    const size_t minBatchSize = 8192;
+    if (count < minBatchSize * 2) {
+        batchSize = std::max<size_t>(count, 1);
+        return 1;
     }
 
-    // This mutex will only be used for the final merge
-    std::mutex filterMutex;
-
-    auto filterTask = [&](size_t start, size_t end) {
-    std::vector<std::string> localFilteredFiles;
-    for (size_t i = start; i < end; ++i) {
-        const std::string& file = files[i];
-        std::string cleanFileName = removeAnsiCodes(file);  // Remove ANSI codes first
-        std::string fileName = cleanFileName;  // Copy the clean file name
-        toLowerInPlace(fileName);  // Convert once to lowercase
-
-        // Check if any of the query tokens is found in the file name
-        bool matchFound = false;
-        for (const std::string& queryToken : queryTokens) {
-            if (!boyerMooreSearch(queryToken, fileName).empty()) {
-                matchFound = true;
-                break;
-            }
-        }
+    size_t numThreads = std::min(static_cast<size_t>(maxThreads), count / minBatchSize);
+    batchSize = (count + numThreads - 1) / numThreads;
+    return (count + batchSize - 1) / batchSize;
+}
 
-        if (matchFound) {
-            localFilteredFiles.push_back(file);  // Push back the original file name with color codes
-        }
+template <typename Body>
+static void runBatches(size_t count, size_t batchSize, size_t numBatches, const Body& body) {
+    if (numBatches == 1) {
+        body(0, count, 0);
+        return;
     }
 
-        // Merge local results into the global filteredFiles vector
-        std::lock_guard<std::mutex> lock(filterMutex);
-        filteredFiles.insert(filteredFiles.end(), localFilteredFiles.begin(), localFilteredFiles.end());
-    };
+    // Filtering runs in the latency lane so it never queues behind bulk copies
+    TaskGroup tasks(globalThreadPool(), nullptr, TaskLane::Interactive);
 
-    size_t numFiles = files.size();
-    size_t numThreads = std::min(static_cast<size_t>(maxThreads), numFiles);
+    for (size_t batch = 0; batch < numBatches; ++batch) {
+        tasks.run([&body, batch, batchSize, count]() {
+            body(batch * batchSize, std::min((batch + 1) * batchSize, count), batch);
+        });
+    }
 
-    // Calculate the batch size based on the number of threads
-    size_t batchSize = (numFiles + numThreads - 1) / numThreads; // This ensures at least one file per thread
+    // Wait for all batches to finish
+    tasks.wait();
+}
 
-    std::vector<std::future<void>> futures;
 
-    // Launch threads to process files in batches
-    for (size_t i = 0; i < numFiles; i += batchSize) {
-        size_t start = i;
-        size_t end = std::min(i + batchSize, numFiles);
-        
-        // Launch each batch processing task asynchronously
-        futures.push_back(std::async(std::launch::async, filterTask, start, end));
+// Function to collect the positions in [0, count) accepted by match, in ascending order
+template <typename Match>
+static std::vector<size_t> filterPositions(size_t count, const Match& match) {
+    size_t batchSize = 0;
+    size_t numBatches = batchCount(count, batchSize);
+
+    // Every batch keeps its own results so the merge needs no lock and keeps the input order
+    std::vector<std::vector<size_t>> batchResults(numBatches);
+    runBatches(count, batchSize, numBatches, [&](size_t begin, size_t end, size_t batch) {
+        for (size_t i = begin; i < end; ++i) {
+            if (match(i)) batchResults[batch].push_back(i);
+        }
+    });
+
+    if (numBatches == 1) {
+        return std::move(batchResults[0]);
     }
 
-    // Wait for all threads to finish
-    for (auto& future : futures) {
-        future.wait();
+    std::vector<size_t> positions;
+    size_t total = 0;
+    for (const auto& result : batchResults) total += result.size();
+    positions.reserve(total);
+    for (const auto& result : batchResults) {
+        positions.insert(positions.end(), result.begin(), result.end());
     }
+    return positions;
+}
+
 
+// Function to put fuzzy matches in score order, best first and equal scores in their given order
+template <typename TextOf>
+static void rankPositions(const FilterMatcher& matcher, std::vector<size_t>& positions, const TextOf& textOf) {
+    if (!matcher.ranked() || positions.size() < 2) return;
+
+    std::vector<int> scores(positions.size());
+    size_t batchSize = 0;
+    size_t numBatches = batchCount(positions.size(), batchSize);
+    runBatches(positions.size(), batchSize, numBatches, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            scores[i] = matcher.score(textOf(positions[i]));
+        }
+    });
+
+    std::vector<size_t> order(positions.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&scores](size_t a, size_t b) {
+        return scores[a] > scores[b];
+    });
+
+    std::vector<size_t> ranked;
+    ranked.reserve(positions.size());
+    for (size_t i : order) ranked.push_back(positions[i]);
+    positions.swap(ranked);
+}
+
+
+// Function to filter cached ISO files or mountpoints based on search query (case-insensitive)
+std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query) {
+    // Tokenize and fold the query once for every file
+    const FilterMatcher matcher(query);
+    if (matcher.empty() || files.empty()) return {};
+
+    std::vector<size_t> positions = filterPositions(files.size(), [&](size_t i) {
+        return matcher.matches(files[i]);
+    });
+    rankPositions(matcher, positions, [&files](size_t i) -> std::string_view { return files[i]; });
+
+    std::vector<std::string> filteredFiles;
+    filteredFiles.reserve(positions.size());
+    for (size_t i : positions) {
+        filteredFiles.push_back(files[i]);  // Original name with color codes
+    }
     return filteredFiles;
 }
 
+
+// Function to filter the ISO list through its folded index. A refinement of a current view
+// only tests that view's survivors again, and both keep the order of their source (sorted, or
+// ranked by an earlier fuzzy filter) so the result needs no sorting unless it is fuzzy itself.
+// resultView receives the positions of the returned files
+std::vector<std::string> filterIsoFiles(const std::string& query, const std::vector<std::string>& filteredFiles, const IsoListView* filteredView, IsoListView& resultView) {
+    resultView = IsoListView{};
+    const FilterMatcher matcher(query);
+    if (matcher.empty()) return {};
+
+    std::lock_guard<std::mutex> lock(updateListMutex);
+
+    std::vector<size_t> positions;
+    if (filteredView) {
+        // The list changed under the view, the filtered names are all that is left to go by
+        if (filteredView->generation != globalIsoListIndex.generation()) {
+            return filterFiles(filteredFiles, query);
+        }
+
+        const std::vector<size_t>& survivors = filteredView->positions;
+        std::vector<size_t> kept = filterPositions(survivors.size(), [&](size_t i) {
+            return matcher.matchesPlain(globalIsoListIndex.folded(survivors[i]));
+        });
+        positions.reserve(kept.size());
+        for (size_t i : kept) {
+            positions.push_back(survivors[i]);
+        }
+    } else if (!filterIsoFilesByTrigrams(matcher, positions)) {
+        // Large libraries answer from the trigram index, everything else is scanned
+        positions = filterPositions(globalIsoListIndex.size(), [&](size_t i) {
+            return matcher.matchesPlain(globalIsoListIndex.folded(i));
+        });
+    }
+
+    rankPositions(matcher, positions, [](size_t i) -> std::string_view { return globalIsoFileList[i]; });
+
+    std::vector<std::string> result;
+    result.reserve(positions.size());
+    for (size_t i : positions) {
+        result.push_back(globalIsoFileList[i]);
+    }
+    resultView.positions = std::move(positions);
+    resultView.generation = globalIsoListIndex.generation();
+    return result;
+}
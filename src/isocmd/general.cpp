@@ -2,39 +2,50 @@
 
 #include "../headers.h"
 #include "../display.h"
+#include "../isolist.h"
 
 
 // For storing isoFiles in RAM
 std::vector<std::string> globalIsoFileList;
 
+// Folded shadow of globalIsoFileList for sorting and filtering
+IsoListIndex globalIsoListIndex;
+
 // Mutex to prevent race conditions when live updating ISO list
 std::mutex updateListMutex;
 
 
-// Function to automatically update ISO list if auto-update is on
-void refreshListAfterAutoUpdate(int timeoutSeconds, std::atomic<bool>& isAtISOList, std::atomic<bool>& isImportRunning, std::atomic<bool>& updateHasRun, std::vector<std::string>& filteredFiles, std::vector<std::string>& sourceList, bool& isFiltered, std::string& listSubtype, std::atomic<bool>& newISOFound) {
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(timeoutSeconds));
-        
-        if (!isImportRunning.load()) {
-			if (newISOFound.load() && isAtISOList.load()) {
-				clearAndLoadFiles(filteredFiles, isFiltered, listSubtype);
-				
-				{
-					std::lock_guard<std::mutex> lock(updateListMutex);
-					sourceList = isFiltered ? filteredFiles : globalIsoFileList;  // Update sourceList
-				}
-            
-				std::cout << "\n";
-				rl_on_new_line(); 
-				rl_redisplay();
-			}
-            updateHasRun.store(false);
-            newISOFound.store(false);
-            
-            break;
-        }
+// ISO prompt state redrawn by the readline event hook, set only while the main ISO prompt reads input
+struct ListRefreshState {
+    std::atomic<bool>* isImportRunning;
+    std::atomic<bool>* newISOFound;
+    std::vector<std::string>* filteredFiles;
+    std::vector<std::string>* sourceList;
+    bool* isFiltered;
+    const std::string* listSubtype;
+};
+
+static ListRefreshState* listRefreshState = nullptr;
+
+
+// Function to automatically update ISO list if auto-update is on. Readline calls it while the main
+// ISO prompt waits for input, so it runs on the thread that owns the list and never under another prompt
+static int refreshListAfterAutoUpdate() {
+    ListRefreshState* state = listRefreshState;
+    if (!state || state->isImportRunning->load() || !state->newISOFound->exchange(false)) {
+        return 0;
+    }
+
+    clearAndLoadFiles(*state->filteredFiles, *state->isFiltered, *state->listSubtype);
+    {
+        std::lock_guard<std::mutex> lock(updateListMutex);
+        *state->sourceList = *state->isFiltered ? *state->filteredFiles : globalIsoFileList;  // Update sourceList
     }
+
+    std::cout << "\n";
+    rl_on_new_line();
+    rl_redisplay();
+    return 0;
 }
 
 
@@ -46,6 +57,9 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
     
     std::set<std::string> operationFiles, skippedMessages, operationFails, uniqueErrorMessages;
     std::vector<std::string> filteredFiles, sourceList;
+
+    // Positions of filteredFiles in globalIsoFileList, lets a refinement test only the survivors
+    IsoListView filteredView;
     
     globalIsoFileList.reserve(100);
     sourceList.reserve(100);
@@ -69,6 +83,8 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
     bool promptFlag = false;
     
     std::string listSubtype = isMount ? "mount" : (write ? "write" : "cp_mv_rm");
+
+    ListRefreshState refreshState{&isImportRunning, &newISOFound, &filteredFiles, &sourceList, &isFiltered, &listSubtype};
         
     while (true) {
 		enable_ctrl_d();
@@ -86,6 +102,7 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
         // Determine source list and load files based on operation type
         if (!isUnmount) {
             if (needsClrScrn) {
+				newISOFound.store(false);  // This load already picks up the latest cache
 				if (!clearAndLoadFiles(filteredFiles, isFiltered, listSubtype)) break;
 				{
 					std::lock_guard<std::mutex> lock(updateListMutex);
@@ -101,13 +118,6 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
             }
         }
         
-        if (updateHasRun.load() && !isUnmount && !globalIsoFileList.empty()) {
-			std::thread(refreshListAfterAutoUpdate, 1, std::ref(isAtISOList), 
-				std::ref(isImportRunning), std::ref(updateHasRun), 
-                std::ref(filteredFiles), std::ref(sourceList), 
-                std::ref(isFiltered), std::ref(listSubtype), std::ref(newISOFound)).detach();
-		}
-        
         std::cout << "\033[1A\033[K";
         
         // Generate prompt
@@ -115,7 +125,14 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
                            + operationColor + "\002" + operation 
                            + "\001\033[1;94m\002, ? ↵ for help, ↵ to return:\001\033[0;1m\002 ";
 
+        // Cache changes redraw the list only while this prompt waits
+        if (updateHasRun.load() && !isUnmount) {
+            listRefreshState = &refreshState;
+            rl_event_hook = refreshListAfterAutoUpdate;
+        }
         std::unique_ptr<char[], decltype(&std::free)> input(readline(prompt.c_str()), &std::free);
+        rl_event_hook = nullptr;
+        listRefreshState = nullptr;
         
         // Handle input processing
         if (!input.get()) break;
@@ -181,9 +198,10 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
 
                 std::string inputSearch(searchQuery.get());
                 
-                // Filter files
-                auto newFilteredFiles = filterFiles(isFiltered ? filteredFiles : sourceList, inputSearch);
-                sortFilesCaseInsensitive(newFilteredFiles);
+                // Filter files, both paths keep the order of their source list unless the query is fuzzy
+                IsoListView newFilteredView;
+                auto newFilteredFiles = isUnmount ? filterFiles(isFiltered ? filteredFiles : sourceList, inputSearch)
+                                                  : filterIsoFiles(inputSearch, filteredFiles, isFiltered ? &filteredView : nullptr, newFilteredView);
 
                 // Check if filter is meaningful
                 bool filterUnchanged = (isMount && newFilteredFiles.size() == globalIsoFileList.size()) ||
@@ -194,6 +212,7 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
                     saveHistory(historyPattern);
                     needsClrScrn = true;
                     filteredFiles = std::move(newFilteredFiles);
+                    filteredView = std::move(newFilteredView);
                     isFiltered = true;
                     historyPattern = false;
                     clear_history();
@@ -209,9 +228,10 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
         if (inputString[0] == '/' && inputString.length() > 1) {
             std::string searchTerm = inputString.substr(1);
             
-            // Filter files
-            auto newFilteredFiles = filterFiles(isFiltered ? filteredFiles : sourceList, searchTerm);
-            sortFilesCaseInsensitive(newFilteredFiles);
+            // Filter files, both paths keep the order of their source list unless the query is fuzzy
+            IsoListView newFilteredView;
+            auto newFilteredFiles = isUnmount ? filterFiles(isFiltered ? filteredFiles : sourceList, searchTerm)
+                                              : filterIsoFiles(searchTerm, filteredFiles, isFiltered ? &filteredView : nullptr, newFilteredView);
 
             // Check if filter is meaningful
             bool filterUnchanged = (isMount && newFilteredFiles.size() == globalIsoFileList.size()) ||
@@ -223,6 +243,7 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
                 add_history(searchTerm.c_str());
                 saveHistory(historyPattern);
                 filteredFiles = std::move(newFilteredFiles);
+                filteredView = std::move(newFilteredView);
                 isFiltered = true;
                 needsClrScrn = true;
             }
@@ -374,10 +395,17 @@ void tokenizeInput(const std::string& input, std::vector<std::string>& isoFiles,
 
 // Function to get the total size of files
 size_t getTotalFileSize(const std::vector<std::string>& files) {
+    // Sizes recorded in the ISO cache spare a stat per file, only unknown paths hit the filesystem
+    std::vector<std::optional<uint64_t>> cachedSizes = getCachedFileSizes(files);
+
     size_t totalSize = 0;
-    for (const auto& file : files) {
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (cachedSizes[i]) {
+            totalSize += *cachedSizes[i];
+            continue;
+        }
         struct stat st;
-        if (stat(file.c_str(), &st) == 0) {
+        if (stat(files[i].c_str(), &st) == 0) {
             totalSize += st.st_size;
         }
     }
@@ -385,6 +413,20 @@ size_t getTotalFileSize(const std::vector<std::string>& files) {
 }
 
 
+// Function to collect the devices a set of files or folders live on, for I/O scheduling
+std::vector<dev_t> devicesOfPaths(const std::vector<std::string>& paths) {
+    std::vector<dev_t> devices;
+    struct stat st;
+    for (const auto& path : paths) {
+        if (!path.empty() && stat(path.c_str(), &st) == 0 &&
+            std::find(devices.begin(), devices.end(), st.st_dev) == devices.end()) {
+            devices.push_back(st.st_dev);
+        }
+    }
+    return devices;
+}
+
+
 // Function to display progress bar for native operations
 void displayProgressBarWithSize(std::atomic<size_t>* completedBytes, size_t totalBytes, std::atomic<size_t>* completedTasks, std::atomic<size_t>* failedTasks, size_t totalTasks, std::atomic<bool>* isComplete, bool* verbose) {
     // Structs to handle terminal settings for non-blocking input
@@ -902,7 +944,9 @@ void helpSelections() {
     std::cout << "\033[1;32m2. Special Commands:\033[0m\n"
 			  << "   • Enter \033[1;34m'~'\033[0m - Switch between compact and full list\n"
               << "   • Enter \033[1;34m'/'\033[0m - Filter the current list based on search terms (e.g., 'term' or 'term1;term2')\n"
-              << "   • Enter \033[1;34m'/term1;term2'\033[0m - Directly filter the list for items containing 'term1' and 'term2'\n" << std::endl;
+              << "   • Enter \033[1;34m'/term1;term2'\033[0m - Directly filter the list for items containing 'term1' and 'term2'\n"
+              << "   • Start terms with \033[1;34m'~'\033[0m for fuzzy matching ranked by score (e.g., '/~dbn12')\n"
+              << "   • Start terms with \033[1;34m'='\033[0m for shell globs on file names, or full paths if they contain '/' (e.g., '/=*debian*12*.iso')\n" << std::endl;
      // Selection tips
     std::cout << "\033[1;32m3. Tips:\033[0m\n"
               << "   • To quickly return from filtered lists to pre-selection, press \033[1;93mCtrl+d\033[0m\n"
@@ -983,7 +1027,8 @@ void helpMappings() {
     std::cout << "\033[1;32m Selecting Mappings:\033[0m\n"
 			  << " • Mapping = NewISOIndex>RemovableUSBDevice\n"
               << " • Single mapping: Enter a mapping (e.g., '1>/dev/sdc')\n"
-              << " • Multiple mappings: Separate with ; (e.g., '1>/dev/sdc;2>/dev/sdd' or '1>/dev/sdc;1>/dev/sdd')\n" << std::endl;
+              << " • Multiple mappings: Separate with ; (e.g., '1>/dev/sdc;2>/dev/sdd' or '1>/dev/sdc;1>/dev/sdd')\n"
+              << " • Verify: Answer 'v' at the confirmation to read each device back and compare it with its ISO\n" << std::endl;
                   
     // Prompt to continue
     std::cout << "\033[1;32m↵ to return...\033[0;1m";
@@ -107,6 +107,8 @@ int main(int argc, char *argv[]) {
 		isImportRunning.store(true);
 		std::thread([maxDepth, &isImportRunning, &newISOFound]() {
 			backgroundCacheImport(maxDepth, isImportRunning, newISOFound);
+			// Keep the cache current from file system events instead of rescanning
+			startCacheWatcher(newISOFound);
 		}).detach();
 		updateHasRun.store(true);
 	}
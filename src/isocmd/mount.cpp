@@ -267,18 +267,16 @@ void processAndMountIsoFiles(const std::string& input, std::vector<std::string>&
         isoChunks.emplace_back(selectedIsoFiles.begin() + i, end);
     }
 
-    ThreadPool pool(numThreads);
-    std::vector<std::future<void>> mountFutures;
+    TaskGroup mountTasks(globalThreadPool(), &g_operationCancelled);
     std::atomic<size_t> completedTasks(0);
     std::atomic<size_t> failedTasks(0);
     std::atomic<bool> isProcessingComplete(false);
 
     // Enqueue chunk tasks
     for (const auto& chunk : isoChunks) {
-        mountFutures.emplace_back(pool.enqueue([&, chunk]() {
-            if (g_operationCancelled.load()) return;
+        mountTasks.run([&, chunk]() {
             mountIsoFiles(chunk, mountedFiles, skippedMessages, mountedFails, &completedTasks, &failedTasks);
-        }));
+        });
     }
 
     // Start progress thread
@@ -293,11 +291,8 @@ void processAndMountIsoFiles(const std::string& input, std::vector<std::string>&
         &verbose
     );
 
-    // Wait for completion or cancellation
-    for (auto& future : mountFutures) {
-        future.wait();
-        if (g_operationCancelled.load()) break;
-    }
+    // Wait for completion, chunks not started before a cancellation are skipped
+    mountTasks.wait();
 
     // Cleanup
     isProcessingComplete.store(true);
@@ -254,8 +254,7 @@ void prepareUnmount(const std::string& input, std::vector<std::string>& currentF
         chunks.emplace_back(selectedMountpoints.begin() + i, end);
     }
 
-    ThreadPool pool(numThreads);
-    std::vector<std::future<void>> unmountFutures;
+    TaskGroup unmountTasks(globalThreadPool(), &g_operationCancelled);
     std::atomic<size_t> completedTasks(0);
     std::atomic<size_t> failedTasks(0);
     std::atomic<bool> isProcessingComplete(false);
@@ -274,17 +273,13 @@ void prepareUnmount(const std::string& input, std::vector<std::string>& currentF
 
     // Enqueue chunk tasks
     for (const auto& chunk : chunks) {
-        unmountFutures.emplace_back(pool.enqueue([&, chunk]() {
-            if (g_operationCancelled.load()) return;
+        unmountTasks.run([&, chunk]() {
             unmountISO(chunk, operationFiles, operationFails, &completedTasks, &failedTasks);
-        }));
+        });
     }
 
-    // Wait for completion or cancellation
-    for (auto& future : unmountFutures) {
-        future.wait();
-        if (g_operationCancelled.load()) break;
-    }
+    // Wait for completion, chunks not started before a cancellation are skipped
+    unmountTasks.wait();
 
     // Cleanup
     isProcessingComplete.store(true);
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GNU General Public License v2.0
 
 #include "../headers.h"
+#include "../cache.h"
 
 
 // Main verbose print function for results
@@ -91,7 +92,7 @@ void verbosePrint(const std::set<std::string>& primarySet, const std::set<std::s
 // CACHE
 
 // Function that provides verbose output for manualRefreshCache
-void verboseIsoCacheRefresh(std::vector<std::string>& allIsoFiles, std::atomic<size_t>& totalFiles, std::vector<std::string>& validPaths, std::set<std::string>& invalidPaths, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& historyPattern, const std::chrono::high_resolution_clock::time_point& start_time, std::atomic<bool>& newISOFound) {
+void verboseIsoCacheRefresh(std::vector<IsoCacheEntry>& allIsoFiles, std::atomic<size_t>& totalFiles, std::vector<std::string>& validPaths, std::set<std::string>& invalidPaths, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& historyPattern, const std::chrono::high_resolution_clock::time_point& start_time, std::atomic<bool>& newISOFound, DirSnapshotScan& snapshots) {
 	signal(SIGINT, SIG_IGN);        // Ignore Ctrl+C
 	disable_ctrl_d();
 	bool saveSuccess;
@@ -126,7 +127,7 @@ void verboseIsoCacheRefresh(std::vector<std::string>& allIsoFiles, std::atomic<s
 	if (g_operationCancelled) {
 		saveSuccess = false;
 	} else {
-		saveSuccess = saveCache(allIsoFiles, maxCacheSize, newISOFound);
+		saveSuccess = saveCache(allIsoFiles, maxCacheSize, newISOFound, &snapshots);
 	}
 
     // Stop the timer after completing the cache refresh and removal of non-existent paths
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#include "../headers.h"
+#include "../threadpool.h"
+#include "../walker.h"
+
+
+// Record layout returned by the getdents64 syscall
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+
+// Shared state of one walk
+struct DirectoryWalk {
+    const DirectoryWalkVisitor& visitor;
+    int maxDepth;
+    std::atomic<bool>& cancelled;
+    TaskGroup tasks;
+
+    DirectoryWalk(const DirectoryWalkVisitor& v, int depth, std::atomic<bool>& cancel) : visitor(v), maxDepth(depth), cancelled(cancel), tasks(globalThreadPool(), &cancel) {}
+};
+
+
+static void readDirectory(DirectoryWalk& walk, const std::string& dirPath, int level);
+
+
+// Function to hand a subdirectory to the shared pool, idle workers steal it from the queue it lands in
+static void scheduleDirectory(DirectoryWalk& walk, std::string dirPath, int level) {
+    walk.tasks.run([&walk, dirPath = std::move(dirPath), level]() {
+        readDirectory(walk, dirPath, level);
+    });
+}
+
+
+// Function to join a directory and an entry name
+static std::string joinWalkPath(const std::string& dir, const char* name) {
+    return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+
+// Function to read one directory with getdents64, files are reported and subdirectories scheduled
+static void readDirectory(DirectoryWalk& walk, const std::string& dirPath, int level) {
+    const DirectoryWalkVisitor& visitor = walk.visitor;
+    const bool descend = walk.maxDepth < 0 || level + 1 <= walk.maxDepth;
+
+    // Only the root may be a symlink, subdirectories are never followed
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (level > 0 ? O_NOFOLLOW : 0);
+    int dirFd = open(dirPath.c_str(), flags);
+    if (dirFd == -1) {
+        if (visitor.onError) visitor.onError(dirPath, errno);
+        return;
+    }
+
+    struct stat dirStat;
+    if (fstat(dirFd, &dirStat) == -1) {
+        if (visitor.onError) visitor.onError(dirPath, errno);
+        close(dirFd);
+        return;
+    }
+
+    std::vector<std::string> subdirs;
+    if (visitor.reuseDirectory && visitor.reuseDirectory(dirPath, dirFd, dirStat, subdirs)) {
+        close(dirFd);
+        if (descend) {
+            for (const auto& name : subdirs) {
+                scheduleDirectory(walk, joinWalkPath(dirPath, name.c_str()), level + 1);
+            }
+        }
+        return;
+    }
+
+    alignas(LinuxDirent64) char buffer[32 * 1024];
+    uint64_t fileCount = 0;
+    bool failed = false;
+
+    while (!walk.cancelled.load(std::memory_order_relaxed)) {
+        long bytes = syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+        if (bytes == 0) break;
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            if (visitor.onError) visitor.onError(dirPath, errno);
+            failed = true;
+            break;
+        }
+
+        for (long offset = 0; offset < bytes;) {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            // Trust d_type, only filesystems that do not fill it in cost a stat per entry
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+            }
+            if (type == DT_LNK) {
+                // Symlinks count when they point at a regular file, symlinked directories are not walked
+                struct stat st;
+                if (fstatat(dirFd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+                    continue;
+                }
+                type = DT_REG;
+            }
+
+            if (type == DT_DIR) {
+                subdirs.emplace_back(name);
+                continue;
+            }
+            if (type != DT_REG) {
+                continue;
+            }
+
+            ++fileCount;
+            if (visitor.onFile) visitor.onFile(dirPath, dirFd, name);
+        }
+    }
+
+    close(dirFd);
+
+    if (walk.cancelled.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    if (descend) {
+        for (const auto& name : subdirs) {
+            scheduleDirectory(walk, joinWalkPath(dirPath, name.c_str()), level + 1);
+        }
+    }
+
+    if (!failed && visitor.onDirectoryRead) {
+        visitor.onDirectoryRead(dirPath, dirStat, subdirs, fileCount);
+    }
+}
+
+
+// Function to walk a directory tree in parallel, subdirectories are spread over the shared pool.
+// Setting cancelled stops the walk, background walks pass their own flag so Ctrl+C stays the user's
+void walkDirectoryTree(const std::string& root, int maxDepth, const DirectoryWalkVisitor& visitor, std::atomic<bool>& cancelled) {
+    std::string rootPath = root;
+    while (rootPath.size() > 1 && rootPath.back() == '/') {
+        rootPath.pop_back();
+    }
+
+    DirectoryWalk walk(visitor, maxDepth, cancelled);
+    scheduleDirectory(walk, std::move(rootPath), 0);
+    walk.tasks.wait();
+}
@@ -0,0 +1,521 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#include "../headers.h"
+#include "../cache.h"
+#include "../threadpool.h"
+
+
+// Events are collected for this long after the first one so bursts end up in a single cache write
+static const int WATCH_BATCH_DELAY_MS = 250;
+
+
+// Changes collected from watch events, applied to the cache in one go
+struct PendingCacheEvents {
+    std::unordered_map<std::string, bool> files;    // path -> true when added, false when removed
+    std::vector<std::string> removedDirs;
+    std::vector<std::string> scannedDirs;
+    bool overflowed = false;    // the kernel dropped events, the roots need a rescan
+
+    bool empty() const {
+        return files.empty() && removedDirs.empty() && scannedDirs.empty() && !overflowed;
+    }
+
+    void addFile(const std::string& path) {
+        files[path] = true;
+    }
+
+    void removeFile(const std::string& path) {
+        files[path] = false;
+    }
+
+    void removeDir(const std::string& path) {
+        // Pending additions below a vanished directory are stale
+        for (auto it = files.begin(); it != files.end();) {
+            if (it->first.size() > path.size() && it->first.compare(0, path.size(), path) == 0 && it->first[path.size()] == '/') {
+                it = files.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        removedDirs.push_back(path);
+    }
+};
+
+
+// Function to check if a filename has the .iso extension (case-insensitive)
+static bool hasIsoExtension(const std::string& name) {
+    return name.size() > 4 && strcasecmp(name.c_str() + name.size() - 4, ".iso") == 0;
+}
+
+
+// Function to check if a path lies inside one of the watched roots
+static bool isUnderRoots(const std::string& path, const std::vector<std::string>& roots) {
+    for (const auto& root : roots) {
+        if (root == "/" || path == root ||
+            (path.size() > root.size() && path.compare(0, root.size(), root) == 0 && path[root.size()] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Function to join a directory and an entry name
+static std::string joinPath(const std::string& dir, const char* name) {
+    return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+
+// Function to stat an ISO and turn it into a cache entry, returns false if it is gone already
+static bool statIsoEntry(const std::string& path, IsoCacheEntry& entry) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    entry.path = path;
+    entry.size = static_cast<uint64_t>(st.st_size);
+    entry.mtime = statTimeToNs(st.st_mtim);
+    entry.ino = static_cast<uint64_t>(st.st_ino);
+    entry.dev = static_cast<uint64_t>(st.st_dev);
+    return true;
+}
+
+
+// Function to collect ISOs below a directory that appeared while watching, each directory is announced before it is read
+static void scanNewDirectory(const std::string& root, std::vector<IsoCacheEntry>& found, const std::function<void(const std::string&)>& onDirectory) {
+    std::vector<std::string> pendingDirs{root};
+    while (!pendingDirs.empty()) {
+        std::string dirPath = std::move(pendingDirs.back());
+        pendingDirs.pop_back();
+        if (onDirectory) {
+            onDirectory(dirPath);
+        }
+
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(dirPath, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code typeEc;
+            if (it->is_directory(typeEc) && !it->is_symlink(typeEc)) {
+                pendingDirs.push_back(it->path().string());
+                continue;
+            }
+            std::string name = it->path().filename().string();
+            IsoCacheEntry entry;
+            if (hasIsoExtension(name) && statIsoEntry(it->path().string(), entry)) {
+                found.push_back(std::move(entry));
+            }
+        }
+    }
+}
+
+
+// Set while a rescan queued after an overflow is running
+static std::atomic<bool> overflowRescanRunning{false};
+
+
+// Function to hand collected events over to the cache
+static void flushCacheEvents(PendingCacheEvents& pending, std::atomic<bool>& newISOFound) {
+    // Lost events are covered by one rescan on the pool, so reading events goes on meanwhile. A
+    // rescan already running may have passed the changed directories, the next flush retries then
+    bool overflowed = pending.overflowed;
+    if (overflowed && !overflowRescanRunning.exchange(true)) {
+        globalThreadPool().submit([&newISOFound]() {
+            backgroundCacheImport(-1, overflowRescanRunning, newISOFound);
+        });
+        overflowed = false;
+    }
+
+    std::vector<IsoCacheEntry> added;
+    std::vector<std::string> removedFiles;
+
+    for (const auto& dir : pending.scannedDirs) {
+        scanNewDirectory(dir, added, {});
+    }
+    for (const auto& [path, isAdded] : pending.files) {
+        IsoCacheEntry entry;
+        if (isAdded && statIsoEntry(path, entry)) {
+            added.push_back(std::move(entry));
+        } else if (!isAdded) {
+            removedFiles.push_back(path);
+        }
+    }
+
+    applyCacheEvents(added, removedFiles, pending.removedDirs, newISOFound);
+    pending = PendingCacheEvents();
+    pending.overflowed = overflowed;
+}
+
+
+// Inotify backend, one watch per directory below the roots
+class InotifyCacheWatcher {
+private:
+    int fd = -1;
+    std::unordered_map<int, std::string> watchPaths;
+    bool limitReported = false;
+
+    static constexpr uint32_t DIR_MASK = IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                         IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+    void addWatch(const std::string& dirPath) {
+        int wd = inotify_add_watch(fd, dirPath.c_str(), DIR_MASK);
+        if (wd >= 0) {
+            watchPaths[wd] = dirPath;
+        } else if (errno == ENOSPC && !limitReported) {
+            // Out of watches (fs.inotify.max_user_watches), the rest is covered by the next import
+            limitReported = true;
+        }
+    }
+
+    // Directories come from the snapshot table where possible, only unknown ones are read
+    void addWatchesBelow(const std::string& root, const DirSnapshotScan& snapshots) {
+        std::vector<std::string> pendingDirs{root};
+        while (!pendingDirs.empty()) {
+            std::string dirPath = std::move(pendingDirs.back());
+            pendingDirs.pop_back();
+            addWatch(dirPath);
+
+            auto known = snapshots.previous.find(dirPath);
+            struct stat st;
+            if (known != snapshots.previous.end() && stat(dirPath.c_str(), &st) == 0 && known->second.matches(st)) {
+                for (const auto& name : known->second.subdirs) {
+                    pendingDirs.push_back(joinPath(dirPath, name.c_str()));
+                }
+                continue;
+            }
+
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(dirPath, ec), end; !ec && it != end; it.increment(ec)) {
+                std::error_code typeEc;
+                if (it->is_directory(typeEc) && !it->is_symlink(typeEc)) {
+                    pendingDirs.push_back(it->path().string());
+                }
+            }
+        }
+    }
+
+    void removeWatchesBelow(const std::string& dirPath) {
+        for (auto it = watchPaths.begin(); it != watchPaths.end();) {
+            const std::string& path = it->second;
+            if (path == dirPath || (path.size() > dirPath.size() && path.compare(0, dirPath.size(), dirPath) == 0 && path[dirPath.size()] == '/')) {
+                inotify_rm_watch(fd, it->first);
+                it = watchPaths.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void handleEvent(const struct inotify_event* event, PendingCacheEvents& pending) {
+        if (event->mask & IN_IGNORED) {
+            watchPaths.erase(event->wd);
+            return;
+        }
+
+        auto watch = watchPaths.find(event->wd);
+        if (watch == watchPaths.end() || event->len == 0) {
+            return;
+        }
+
+        std::string path = joinPath(watch->second, event->name);
+
+        if (event->mask & IN_ISDIR) {
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                // Each directory is watched before it is read so nothing created meanwhile is missed
+                std::vector<IsoCacheEntry> found;
+                scanNewDirectory(path, found, [this](const std::string& dir) { addWatch(dir); });
+                for (const auto& entry : found) {
+                    pending.addFile(entry.path);
+                }
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                removeWatchesBelow(path);
+                pending.removeDir(path);
+            }
+            return;
+        }
+
+        if (!hasIsoExtension(event->name)) {
+            return;
+        }
+        if (event->mask & (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            pending.addFile(path);
+        } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            pending.removeFile(path);
+        }
+    }
+
+public:
+    ~InotifyCacheWatcher() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool init(const std::vector<std::string>& roots) {
+        fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (fd == -1) {
+            return false;
+        }
+
+        DirSnapshotScan snapshots;
+        loadDirSnapshots(snapshots);
+        for (const auto& root : roots) {
+            addWatchesBelow(root, snapshots);
+        }
+        return !watchPaths.empty();
+    }
+
+    void run(std::atomic<bool>& newISOFound) {
+        alignas(struct inotify_event) char buffer[64 * 1024];
+        PendingCacheEvents pending;
+
+        while (true) {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, pending.empty() ? -1 : WATCH_BATCH_DELAY_MS);
+            if (ready == -1) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (ready == 0) {
+                flushCacheEvents(pending, newISOFound);
+                continue;
+            }
+
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                if (length == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+                break;
+            }
+
+            for (char* ptr = buffer; ptr < buffer + length;) {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+                if (event->mask & IN_Q_OVERFLOW) {
+                    // Events were lost, the roots are rescanned once the batch is flushed
+                    pending.overflowed = true;
+                } else {
+                    handleEvent(event, pending);
+                }
+                ptr += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+};
+
+
+// Fanotify backend for root, a single filesystem mark replaces per-directory watches
+class FanotifyCacheWatcher {
+private:
+    int fd = -1;
+    std::vector<std::string> roots;
+    std::map<std::pair<int32_t, int32_t>, int> mountFds;    // fsid -> fd of a directory on that filesystem
+    std::unordered_map<std::string, std::string> dirPaths;  // fsid and file handle -> resolved directory path
+
+    // Resolved directories kept before the table is dropped and rebuilt from new events
+    static constexpr size_t DIR_PATH_CACHE_LIMIT = 65536;
+
+    static constexpr uint64_t EVENT_MASK = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR;
+
+    // Resolve the directory file handle of an event to a path, directories seen before are not opened again
+    std::string resolveDirectory(const struct fanotify_event_info_fid* fid) {
+        auto mount = mountFds.find({fid->fsid.val[0], fid->fsid.val[1]});
+        if (mount == mountFds.end()) {
+            return "";
+        }
+
+        struct file_handle* handle = (struct file_handle*)fid->handle;
+        std::string key(reinterpret_cast<const char*>(&fid->fsid), sizeof(fid->fsid));
+        key.append(reinterpret_cast<const char*>(&handle->handle_type), sizeof(handle->handle_type));
+        key.append(reinterpret_cast<const char*>(handle->f_handle), handle->handle_bytes);
+        auto cached = dirPaths.find(key);
+        if (cached != dirPaths.end()) {
+            return cached->second;
+        }
+
+        int dirFd = open_by_handle_at(mount->second, handle, O_RDONLY | O_PATH);
+        if (dirFd == -1) {
+            return "";
+        }
+
+        char linkPath[64];
+        char resolved[PATH_MAX];
+        snprintf(linkPath, sizeof(linkPath), "/proc/self/fd/%d", dirFd);
+        ssize_t length = readlink(linkPath, resolved, sizeof(resolved) - 1);
+        close(dirFd);
+        if (length <= 0) {
+            return "";
+        }
+
+        if (dirPaths.size() >= DIR_PATH_CACHE_LIMIT) {
+            dirPaths.clear();
+        }
+        std::string dirPath(resolved, static_cast<size_t>(length));
+        dirPaths.emplace(std::move(key), dirPath);
+        return dirPath;
+    }
+
+    // A moved or deleted directory invalidates the cached paths of itself and everything below it
+    void forgetDirectoriesBelow(const std::string& dirPath) {
+        for (auto it = dirPaths.begin(); it != dirPaths.end();) {
+            const std::string& path = it->second;
+            if (path == dirPath || (path.size() > dirPath.size() && path.compare(0, dirPath.size(), dirPath) == 0 && path[dirPath.size()] == '/')) {
+                it = dirPaths.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void handleEvent(const struct fanotify_event_metadata* metadata, PendingCacheEvents& pending) {
+        const char* info = reinterpret_cast<const char*>(metadata) + metadata->metadata_len;
+        const char* end = reinterpret_cast<const char*>(metadata) + metadata->event_len;
+
+        while (info + sizeof(struct fanotify_event_info_header) <= end) {
+            const struct fanotify_event_info_fid* fid = reinterpret_cast<const struct fanotify_event_info_fid*>(info);
+            if (fid->hdr.len == 0) {
+                break;
+            }
+            if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                const struct file_handle* handle = reinterpret_cast<const struct file_handle*>(fid->handle);
+                const char* name = reinterpret_cast<const char*>(handle->f_handle) + handle->handle_bytes;
+
+                // The filesystem mark reports every file, only directories and ISOs are worth resolving
+                const bool isDir = metadata->mask & FAN_ONDIR;
+                if ((!isDir && !hasIsoExtension(name)) || std::strcmp(name, ".") == 0) {
+                    return;
+                }
+
+                std::string dirPath = resolveDirectory(fid);
+                if (dirPath.empty()) {
+                    return;
+                }
+
+                std::string path = joinPath(dirPath, name);
+                if (isDir && (metadata->mask & (FAN_DELETE | FAN_MOVED_FROM))) {
+                    forgetDirectoriesBelow(path);
+                }
+                if (!isUnderRoots(path, roots)) {
+                    return;
+                }
+
+                if (isDir) {
+                    if (metadata->mask & (FAN_CREATE | FAN_MOVED_TO)) {
+                        pending.scannedDirs.push_back(path);
+                    } else if (metadata->mask & (FAN_DELETE | FAN_MOVED_FROM)) {
+                        pending.removeDir(path);
+                    }
+                } else {
+                    if (metadata->mask & (FAN_CREATE | FAN_CLOSE_WRITE | FAN_MOVED_TO)) {
+                        pending.addFile(path);
+                    } else if (metadata->mask & (FAN_DELETE | FAN_MOVED_FROM)) {
+                        pending.removeFile(path);
+                    }
+                }
+                return;
+            }
+            info += fid->hdr.len;
+        }
+    }
+
+public:
+    ~FanotifyCacheWatcher() {
+        for (const auto& [fsid, mountFd] : mountFds) {
+            close(mountFd);
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool init(const std::vector<std::string>& watchRoots) {
+        if (geteuid() != 0) {
+            return false;
+        }
+
+        fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE);
+        if (fd == -1) {
+            return false;
+        }
+
+        for (const auto& trimmed : watchRoots) {
+            struct statfs fs;
+            if (statfs(trimmed.c_str(), &fs) != 0) {
+                continue;
+            }
+            std::pair<int32_t, int32_t> fsid{fs.f_fsid.__val[0], fs.f_fsid.__val[1]};
+            if (mountFds.count(fsid) == 0) {
+                if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, EVENT_MASK, AT_FDCWD, trimmed.c_str()) == -1) {
+                    continue;
+                }
+                int mountFd = open(trimmed.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (mountFd == -1) {
+                    continue;
+                }
+                mountFds[fsid] = mountFd;
+            }
+            roots.push_back(trimmed);
+        }
+        return !roots.empty();
+    }
+
+    void run(std::atomic<bool>& newISOFound) {
+        alignas(struct fanotify_event_metadata) char buffer[64 * 1024];
+        PendingCacheEvents pending;
+
+        while (true) {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, pending.empty() ? -1 : WATCH_BATCH_DELAY_MS);
+            if (ready == -1) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (ready == 0) {
+                flushCacheEvents(pending, newISOFound);
+                continue;
+            }
+
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                if (length == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+                break;
+            }
+
+            const struct fanotify_event_metadata* metadata = reinterpret_cast<const struct fanotify_event_metadata*>(buffer);
+            while (FAN_EVENT_OK(metadata, length)) {
+                if (metadata->mask & FAN_Q_OVERFLOW) {
+                    // Events were lost, the roots are rescanned once the batch is flushed
+                    pending.overflowed = true;
+                } else {
+                    handleEvent(metadata, pending);
+                }
+                metadata = FAN_EVENT_NEXT(metadata, length);
+            }
+        }
+    }
+};
+
+
+// Function to keep the ISO cache in sync with the automatic import folders for the rest of the session
+void startCacheWatcher(std::atomic<bool>& newISOFound) {
+    std::vector<std::string> roots = loadAutoImportRoots();
+    if (roots.empty()) {
+        return;
+    }
+
+    // Roots are stored with a trailing slash, watch paths and snapshot keys have none
+    for (auto& root : roots) {
+        while (root.size() > 1 && root.back() == '/') {
+            root.pop_back();
+        }
+    }
+
+    std::thread([roots, &newISOFound]() {
+        FanotifyCacheWatcher fanotifyWatcher;
+        if (fanotifyWatcher.init(roots)) {
+            fanotifyWatcher.run(newISOFound);
+            return;
+        }
+
+        InotifyCacheWatcher inotifyWatcher;
+        if (inotifyWatcher.init(roots)) {
+            inotifyWatcher.run(newISOFound);
+        }
+    }).detach();
+}
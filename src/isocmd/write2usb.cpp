@@ -2,8 +2,13 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../asyncio.h"
 #include "../write.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 // Shared progress data
 std::vector<ProgressInfo> progressData;
@@ -246,7 +251,7 @@ std::vector<std::string> getRemovableDevices() {
 
 
 // Function to handle device mapping collection and validation
-std::vector<std::pair<IsoInfo, std::string>> collectDeviceMappings(const std::vector<IsoInfo>& selectedIsos,std::set<std::string>& uniqueErrorMessages) {
+std::vector<std::pair<IsoInfo, std::string>> collectDeviceMappings(const std::vector<IsoInfo>& selectedIsos,std::set<std::string>& uniqueErrorMessages, bool& verify) {
     while (true) {
 		signal(SIGINT, SIG_IGN);        // Ignore Ctrl+C
 		disable_ctrl_d();
@@ -469,10 +474,12 @@ std::vector<std::pair<IsoInfo, std::string>> collectDeviceMappings(const std::ve
 		rl_bind_keyseq("\033[B", prevent_readline_keybindings); // Down arrow
 
         std::unique_ptr<char, decltype(&std::free)> confirmation(
-            readline("\n\001\033[1;94m\002Proceed? (y/n): \001\033[0;1m\002"), &std::free
+            readline("\n\001\033[1;94m\002Proceed? (y/n, v to verify after writing): \001\033[0;1m\002"), &std::free
         );
 
-        if (confirmation && (confirmation.get()[0] == 'y' || confirmation.get()[0] == 'Y')) {
+        if (confirmation && (confirmation.get()[0] == 'y' || confirmation.get()[0] == 'Y' ||
+                             confirmation.get()[0] == 'v' || confirmation.get()[0] == 'V')) {
+            verify = confirmation.get()[0] == 'v' || confirmation.get()[0] == 'V';
 			rl_bind_keyseq("\033[A", rl_get_previous_history);
             rl_bind_keyseq("\033[B", rl_get_next_history);
             setupSignalHandlerCancellations();
@@ -491,7 +498,7 @@ std::vector<std::pair<IsoInfo, std::string>> collectDeviceMappings(const std::ve
 
 
 // Function to send writes to writeToUsb
-void performWriteOperation(const std::vector<std::pair<IsoInfo, std::string>>& validPairs) {
+void performWriteOperation(const std::vector<std::pair<IsoInfo, std::string>>& validPairs, bool verify) {
     // Reset progress data before starting a new operation
     progressData.clear();
     progressData.reserve(validPairs.size());
@@ -510,9 +517,7 @@ void performWriteOperation(const std::vector<std::pair<IsoInfo, std::string>>& v
     std::atomic<size_t> completedTasks(0);
     std::atomic<bool> isProcessingComplete(false);
     const size_t totalTasks = validPairs.size();
-    const unsigned int numThreads = std::min(static_cast<unsigned int>(totalTasks), 
-                                           static_cast<unsigned int>(maxThreads));
-    ThreadPool pool(numThreads);
+    TaskGroup writeTasks(globalThreadPool(), &g_operationCancelled);
 
     disableInput();
     clearScrollBuffer();
@@ -521,18 +526,37 @@ void performWriteOperation(const std::vector<std::pair<IsoInfo, std::string>>& v
 
     auto startTime = std::chrono::high_resolution_clock::now();
 
-    // Launch tasks
-    std::vector<std::future<void>> futures;
+    // Devices receiving the same ISO share one reader
+    std::map<std::string, std::vector<size_t>> pairsByIso;
     for (size_t i = 0; i < totalTasks; ++i) {
-        futures.push_back(pool.enqueue([&, i]() {
-            const auto& [iso, device] = validPairs[i];
-            bool success = writeIsoToDevice(iso.path, device, i);
-            
-            if (success) {
-                progressData[i].completed.store(true);
-                completedTasks.fetch_add(1);
+        pairsByIso[validPairs[i].first.path].push_back(i);
+    }
+
+    // Launch tasks
+    for (const auto& [isoPath, indices] : pairsByIso) {
+        if (indices.size() == 1) {
+            const size_t i = indices.front();
+            writeTasks.run([&, i]() {
+                const auto& [iso, device] = validPairs[i];
+                bool success = writeIsoToDevice(iso.path, device, i, verify);
+                
+                if (success) {
+                    progressData[i].completed.store(true);
+                    completedTasks.fetch_add(1);
+                }
+            });
+            continue;
+        }
+
+        writeTasks.run([&, indices = indices]() {
+            std::vector<std::string> devices;
+            for (size_t i : indices) devices.push_back(validPairs[i].second);
+            broadcastIsoToDevices(validPairs[indices.front()].first.path, indices, devices, verify);
+
+            for (size_t i : indices) {
+                if (progressData[i].completed.load()) completedTasks.fetch_add(1);
             }
-        }));
+        });
     }
 
     // Create separate maps for device information
@@ -568,8 +592,9 @@ void performWriteOperation(const std::vector<std::pair<IsoInfo, std::string>>& v
 						<< ("\033[1;95m" + prog.filename + " \033[0;1m→ {" + 
                           "\033[1;93m" + prog.device + "\033[0;1m \033[0;1m<" + deviceNames[prog.device] + "> (\033[1;35m" + deviceSizeStrs[prog.device] + "\033[0;1m)} \033[0;1m")
 						<< std::right
-						<< (prog.completed ? "\033[1;92mDONE\033[0;1m" :
-							prog.failed ? "\033[1;91mFAIL\033[0;1m" :
+						<< (prog.completed ? (prog.verified ? "\033[1;92mVERIFIED\033[0;1m" : "\033[1;92mDONE\033[0;1m") :
+							prog.failed ? (prog.mismatchOffset >= 0 ? "\033[1;91mMISMATCH @ " + std::to_string(prog.mismatchOffset.load()) + "\033[0;1m" : "\033[1;91mFAIL\033[0;1m") :
+							prog.verifying ? "\033[1;94mVERIFY " + std::to_string(prog.progress) + "%\033[0;1m" :
 							std::to_string(prog.progress) + "%")
 						<< " ["
 						<< currentSize
@@ -586,10 +611,7 @@ void performWriteOperation(const std::vector<std::pair<IsoInfo, std::string>>& v
     std::thread progressThread(displayProgress);
 
     // Wait for all tasks to complete
-    for (auto& future : futures) {
-        future.wait();
-        if (g_operationCancelled.load()) break;
-    }
+    writeTasks.wait();
     
     isProcessingComplete.store(true, std::memory_order_release);
     progressThread.join();
@@ -601,6 +623,15 @@ void performWriteOperation(const std::vector<std::pair<IsoInfo, std::string>>& v
 	std::cout << "\n\033[0;1mCompleted: \033[1;92m" << completedTasks.load()
 			<< "\033[0;1m/\033[1;93m" << validPairs.size() 
 			<< "\033[0;1m in \033[0;1m" << duration << " seconds.\033[0;1m\n";
+
+    // Verification failures name the first byte the device got wrong
+    for (const auto& prog : progressData) {
+        if (prog.mismatchOffset >= 0) {
+            std::cout << "\n\033[1;91mVerification failed: \033[1;93m" << prog.device
+                      << "\033[1;91m differs from \033[1;95m" << prog.filename
+                      << "\033[1;91m at byte offset \033[0;1m" << prog.mismatchOffset.load() << "\033[1;91m.\033[0;1m\n";
+        }
+    }
     
     if (g_operationCancelled.load()) {
         std::cout << "\n\033[1;33mWrite operation interrupted by user.\033[0;1m\n";
@@ -623,26 +654,40 @@ void writeToUsb(const std::string& input, std::vector<std::string>& isoFiles, st
         return;
     }
 
+    // Sizes come from the ISO cache, only entries without metadata are stat'ed
+    std::vector<std::string> selectedPaths;
+    for (int idx : indicesToProcess) {
+        selectedPaths.push_back(isoFiles[idx - 1]);
+    }
+    std::vector<std::optional<uint64_t>> cachedSizes = getCachedFileSizes(selectedPaths);
+
     std::vector<IsoInfo> selectedIsos;
+    size_t selectionIndex = 0;
     for (int idx : indicesToProcess) {
-        try {
+        const std::string& isoPath = isoFiles[idx - 1];
+        std::optional<uint64_t> fileSize = cachedSizes[selectionIndex++];
+
+        if (!fileSize) {
             // Check if the file exists before processing
-            if (!std::filesystem::exists(isoFiles[idx - 1])) {
-                uniqueErrorMessages.insert("\033[1;35mMissing: \033[1;93m'" + isoFiles[idx - 1] + "'\033[1;35m.");
-                continue;
+            struct stat st;
+            if (stat(isoPath.c_str(), &st) != 0) {
+                if (errno == ENOENT) {
+                    uniqueErrorMessages.insert("\033[1;35mMissing: \033[1;93m'" + isoPath + "'\033[1;35m.");
+                } else {
+                    uniqueErrorMessages.insert("\033[1;91mError accessing ISO file: " + isoPath + ": " + std::string(strerror(errno)) + ".");
+                }
+                continue;  // Skip this file and proceed with the next one
             }
-
-            selectedIsos.emplace_back(IsoInfo{
-                isoFiles[idx - 1],
-                std::filesystem::path(isoFiles[idx - 1]).filename().string(),
-                std::filesystem::file_size(isoFiles[idx - 1]),
-                formatFileSize(std::filesystem::file_size(isoFiles[idx - 1])),
-                static_cast<size_t>(idx)
-            });
-        } catch (const std::filesystem::filesystem_error& e) {
-            uniqueErrorMessages.insert("\033[1;91mError accessing ISO file: " + std::string(e.what()) + ".");
-            continue;  // Skip this file and proceed with the next one
+            fileSize = static_cast<uint64_t>(st.st_size);
         }
+
+        selectedIsos.emplace_back(IsoInfo{
+            isoPath,
+            std::filesystem::path(isoPath).filename().string(),
+            *fileSize,
+            formatFileSize(*fileSize),
+            static_cast<size_t>(idx)
+        });
     }
 
     if (selectedIsos.empty()) {
@@ -650,13 +695,14 @@ void writeToUsb(const std::string& input, std::vector<std::string>& isoFiles, st
         return;
     }
 
-    auto validPairs = collectDeviceMappings(selectedIsos, uniqueErrorMessages);
+    bool verify = false;
+    auto validPairs = collectDeviceMappings(selectedIsos, uniqueErrorMessages, verify);
     if (validPairs.empty()) {
         clear_history();
         return;
     }
 
-    performWriteOperation(validPairs);
+    performWriteOperation(validPairs, verify);
     signal(SIGINT, SIG_IGN);        // Ignore Ctrl+C
 	disable_ctrl_d();
     std::cout << "\n\033[1;32m↵ to continue...\033[0;1m";
@@ -664,108 +710,422 @@ void writeToUsb(const std::string& input, std::vector<std::string>& isoFiles, st
 }
 
 
-// Function to write ISO to USB device
-bool writeIsoToDevice(const std::string& isoPath, const std::string& device, size_t progressIndex) {
-    // Open ISO file
-    std::ifstream iso(isoPath, std::ios::binary);
-    if (!iso) {
-        progressData[progressIndex].failed.store(true);
-        return false;
+// ISO opened for one front-to-back pass, O_DIRECT keeps a multi-GB image from evicting the page cache on its way through
+struct IsoSource {
+    int fd = -1;
+    bool direct = true;
+
+    ~IsoSource() {
+        if (fd != -1) close(fd);
+    }
+
+    bool open(const std::string& isoPath) {
+        fd = ::open(isoPath.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (fd == -1) {
+            fd = ::open(isoPath.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return false;
+            useCachedReads();
+        }
+        return true;
+    }
+
+    // Function to fall back to cached reads that the kernel may drop right behind us
+    void useCachedReads() {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags != -1) fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+        direct = false;
+    }
+
+    // Cached pages of the image are of no further use
+    void dropCache() {
+        if (!direct) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    // Function to read want bytes at offset into an aligned buffer of bufferSize. Direct reads ask for
+    // whole aligned blocks; when the very first one is refused the image is read through the cache.
+    bool readAt(char* buffer, size_t want, uint64_t offset, size_t alignment, size_t bufferSize) {
+        auto readBlock = [&]() {
+            const size_t length = direct ? std::min(bufferSize, (want + alignment - 1) / alignment * alignment) : want;
+            size_t got = 0;
+            while (got < want) {
+                ssize_t result = pread(fd, buffer + got, length - got, static_cast<off_t>(offset + got));
+                if (result == -1 && errno == EINTR) continue;
+                if (result <= 0) break;
+                got += static_cast<size_t>(result);
+            }
+            return got >= want;
+        };
+
+        if (readBlock()) {
+            return true;
+        }
+        if (!direct || offset != 0) {
+            return false;
+        }
+        useCachedReads();
+        return readBlock();
     }
+};
+
+
+// Byte count and speed of one write in progressData, the speed is refreshed every 500 ms
+struct WriteProgressMeter {
+    size_t progressIndex;
+    uint64_t fileSize;
+    std::chrono::high_resolution_clock::time_point lastUpdate = std::chrono::high_resolution_clock::now();
+    uint64_t bytesInWindow = 0;
+    static constexpr int UPDATE_INTERVAL_MS = 500;
 
+    WriteProgressMeter(size_t index, uint64_t size) : progressIndex(index), fileSize(size) {}
+
+    void add(size_t bytesWritten) {
+        // Atomically update progress
+        progressData[progressIndex].bytesWritten.fetch_add(bytesWritten);
+        bytesInWindow += bytesWritten;
+
+        // Update progress and speed
+        auto now = std::chrono::high_resolution_clock::now();
+        auto timeSinceLastUpdate = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastUpdate);
+
+        if (timeSinceLastUpdate.count() >= UPDATE_INTERVAL_MS) {
+            // Calculate and update progress atomically
+            const int progress = static_cast<int>((static_cast<double>(progressData[progressIndex].bytesWritten.load()) / fileSize) * 100);
+            progressData[progressIndex].progress.store(progress);
+
+            // Calculate and update speed atomically
+            double seconds = timeSinceLastUpdate.count() / 1000.0;
+            double mbPerSec = (static_cast<double>(bytesInWindow) / (1024 * 1024)) / seconds;
+            progressData[progressIndex].speed.store(mbPerSec);
+
+            // Reset window counters
+            lastUpdate = now;
+            bytesInWindow = 0;
+        }
+    }
+};
+
+
+// Function to open a device for direct writes of fileSize bytes, returns its descriptor or -1
+static int openTargetDevice(const std::string& device, uint64_t fileSize, int& sectorSize) {
     // Open device with O_DIRECT
-    int device_fd = open(device.c_str(), O_WRONLY | O_DIRECT);
+    int device_fd = open(device.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
     if (device_fd == -1) {
-        progressData[progressIndex].failed.store(true);
-        return false;
+        return -1;
     }
 
-    // Get device sector size
-    int sectorSize = 0;
-    if (ioctl(device_fd, BLKSSZGET, &sectorSize) < 0 || sectorSize == 0) {
-        progressData[progressIndex].failed.store(true);
+    // Get device sector size, the ISO must fill whole sectors
+    sectorSize = 0;
+    if (ioctl(device_fd, BLKSSZGET, &sectorSize) < 0 || sectorSize == 0 || fileSize % sectorSize != 0) {
         close(device_fd);
-        return false;
+        return -1;
     }
+    return device_fd;
+}
 
-    // Get ISO file size and check alignment
-    const uint64_t fileSize = std::filesystem::file_size(isoPath);
-    if (fileSize % sectorSize != 0) {
-        progressData[progressIndex].failed.store(true);
-        close(device_fd);
-        return false;
+
+// Function to get the block size for direct I/O on both sides (4MB default)
+static size_t writeBlockSize(size_t alignment) {
+    size_t bufferSize = 4 * 1024 * 1024;
+    bufferSize = (bufferSize / alignment) * alignment;
+    return bufferSize == 0 ? alignment : bufferSize;
+}
+
+
+// Function to find the first differing byte of two buffers, length if they are equal
+static size_t firstMismatch(const char* a, const char* b, size_t length) {
+    size_t at = 0;
+#if defined(__SSE2__)
+    // 64 bytes per step, the exact byte is only searched for inside a differing step
+    for (; at + 64 <= length; at += 64) {
+        __m128i diff = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + at)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + at))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + at + 16)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + at + 16)))),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + at + 32)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + at + 32))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + at + 48)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + at + 48)))));
+        if (_mm_movemask_epi8(diff) != 0xFFFF) {
+            break;
+        }
+    }
+#endif
+    for (; at < length; ++at) {
+        if (a[at] != b[at]) return at;
     }
+    return length;
+}
 
-    // Set buffer size as multiple of sector size (8MB default)
-    size_t bufferSize = 8 * 1024 * 1024;
-    bufferSize = (bufferSize / sectorSize) * sectorSize;
-    if (bufferSize == 0) bufferSize = sectorSize;
 
-    // Allocate aligned buffer
-    char* alignedBuffer = nullptr;
-    if (posix_memalign((void**)&alignedBuffer, sectorSize, bufferSize) != 0) {
-        progressData[progressIndex].failed.store(true);
-        close(device_fd);
-        return false;
+// Function to read every block of the ISO once into a small pool of shared aligned buffers and hand
+// it to each consumer still taking blocks. Every consumer drains its own queue on its own thread, so
+// a fast device only waits once it is a whole buffer pool ahead of the slowest one. consume(i, data,
+// offset, length) returns false to drop consumer i; finish(i, complete) then runs on that thread, with
+// complete set only when consumer i took every byte of the image.
+template <typename Consume, typename Finish>
+static void shareIsoBlocks(IsoSource& iso, uint64_t fileSize, size_t alignment, size_t consumerCount, Consume consume, Finish finish) {
+    constexpr size_t SHARED_BUFFERS = 8;
+
+    struct Block {
+        char* data = nullptr;
+        uint64_t offset = 0;
+        size_t length = 0;
+        size_t refs = 0;    // consumers still to take it, guarded by mutex
+    };
+
+    struct Consumer {
+        bool dropped = false;   // only touched by the consumer's thread until it is joined
+        std::atomic<bool> taking{true};
+        uint64_t consumed = 0;
+        std::deque<Block*> queue;
+        std::thread thread;
+    };
+
+    const size_t bufferSize = writeBlockSize(alignment);
+    std::vector<Block> blocks(SHARED_BUFFERS);
+    std::vector<Block*> idle;
+    bool allocated = true;
+    for (Block& block : blocks) {
+        allocated = allocated && posix_memalign(reinterpret_cast<void**>(&block.data), alignment, bufferSize) == 0;
+        if (allocated) idle.push_back(&block);
+        else block.data = nullptr;
+    }
+    if (!allocated) {
+        for (Block& block : blocks) std::free(block.data);
+        for (size_t i = 0; i < consumerCount; ++i) finish(i, false);
+        return;
     }
-    std::unique_ptr<char, decltype(&free)> bufferGuard(alignedBuffer, &free);
 
-    // Initialize timing and speed calculation variables
-    auto startTime = std::chrono::high_resolution_clock::now();
-    auto lastUpdate = startTime;
-    uint64_t bytesInWindow = 0;
-    const int UPDATE_INTERVAL_MS = 500;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool readerDone = false;
 
-    try {
-        while (progressData[progressIndex].bytesWritten.load() < fileSize && !g_operationCancelled) {
-            const uint64_t totalWritten = progressData[progressIndex].bytesWritten.load();
-            const uint64_t remaining = fileSize - totalWritten;
-            const size_t bytesToRead = std::min(bufferSize, static_cast<size_t>(remaining));
+    // Function to hand a block back once no consumer needs it anymore
+    auto release = [&](Block* block) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--block->refs == 0) idle.push_back(block);
+        }
+        cv.notify_all();
+    };
+
+    std::deque<Consumer> consumers(consumerCount);
+    for (size_t i = 0; i < consumerCount; ++i) {
+        Consumer& consumer = consumers[i];
+        consumer.thread = std::thread([&, i, &consumer = consumer]() {
+            while (true) {
+                Block* block;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return !consumer.queue.empty() || readerDone; });
+                    if (consumer.queue.empty()) break;
+                    block = consumer.queue.front();
+                    consumer.queue.pop_front();
+                }
 
-            iso.read(alignedBuffer, bytesToRead);
-            const std::streamsize bytesRead = iso.gcount();
-            
-            if (bytesRead <= 0 || static_cast<size_t>(bytesRead) != bytesToRead) {
-                throw std::runtime_error("Read error");
+                // A dropped consumer keeps draining its queue so the shared blocks get released
+                if (!consumer.dropped && !g_operationCancelled.load()) {
+                    if (consume(i, block->data, block->offset, block->length)) {
+                        consumer.consumed += block->length;
+                    } else {
+                        consumer.dropped = true;
+                        consumer.taking.store(false);
+                    }
+                }
+                release(block);
             }
+            finish(i, !consumer.dropped && consumer.consumed == fileSize);
+        });
+    }
+
+    for (uint64_t offset = 0; offset < fileSize && !g_operationCancelled.load(); offset += bufferSize) {
+        Block* block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return !idle.empty(); });
+            block = idle.back();
+            idle.pop_back();
+        }
 
-            // Handle partial writes
-            ssize_t bytesWritten = 0;
-            while (bytesWritten < static_cast<ssize_t>(bytesToRead)) {
-                size_t chunk = std::min(static_cast<size_t>(bytesToRead - bytesWritten), bufferSize);
-                chunk = (chunk / sectorSize) * sectorSize;
-                if (chunk == 0) break;
-                ssize_t result = write(device_fd, alignedBuffer + bytesWritten, chunk);
-                if (result == -1) {
-                    throw std::runtime_error("Write error");
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(bufferSize, fileSize - offset));
+        const bool haveBlock = iso.readAt(block->data, want, offset, alignment, bufferSize);
+
+        size_t queued = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (haveBlock) {
+                block->offset = offset;
+                block->length = want;
+                for (Consumer& consumer : consumers) {
+                    if (!consumer.taking.load()) continue;
+                    consumer.queue.push_back(block);
+                    ++queued;
                 }
-                bytesWritten += result;
             }
+            block->refs = queued;
+            if (queued == 0) idle.push_back(block);
+        }
+        cv.notify_all();
 
-            // Atomically update progress
-            progressData[progressIndex].bytesWritten.fetch_add(bytesWritten);
-            bytesInWindow += bytesWritten;
+        // A failed read leaves every consumer short of the image size
+        if (!haveBlock || queued == 0) {
+            break;
+        }
+    }
 
-            // Update progress and speed
-            auto now = std::chrono::high_resolution_clock::now();
-            auto timeSinceLastUpdate = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastUpdate);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        readerDone = true;
+    }
+    cv.notify_all();
 
-            if (timeSinceLastUpdate.count() >= UPDATE_INTERVAL_MS) {
-                // Calculate and update progress atomically
-                const int progress = static_cast<int>((static_cast<double>(progressData[progressIndex].bytesWritten.load()) / fileSize) * 100);
-                progressData[progressIndex].progress.store(progress);
+    for (Consumer& consumer : consumers) {
+        consumer.thread.join();
+    }
+    for (Block& block : blocks) {
+        std::free(block.data);
+    }
+}
 
-                // Calculate and update speed atomically
-                double seconds = timeSinceLastUpdate.count() / 1000.0;
-                double mbPerSec = (static_cast<double>(bytesInWindow) / (1024 * 1024)) / seconds;
-                progressData[progressIndex].speed.store(mbPerSec);
 
-                // Reset window counters
-                lastUpdate = now;
-                bytesInWindow = 0;
-            }
+// Function to read written devices back past their cache and compare them with the ISO, which is
+// read once for all of them. The first differing byte is kept in mismatchOffset; a clean pass marks
+// the device verified, the caller marks it completed.
+static void verifyDevices(IsoSource& iso, uint64_t fileSize, const std::vector<std::pair<size_t, std::string>>& devices) {
+    struct Reader {
+        size_t progressIndex;
+        int fd = -1;
+        char* buffer = nullptr;
+    };
+
+    std::vector<Reader> readers;
+    size_t alignment = 4096;
+    for (const auto& [progressIndex, device] : devices) {
+        ProgressInfo& progress = progressData[progressIndex];
+        progress.progress.store(0);
+        progress.verifying.store(true);
+
+        int fd = open(device.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+        int sectorSize = 0;
+        if (fd == -1 || ioctl(fd, BLKSSZGET, &sectorSize) != 0 || sectorSize <= 0) {
+            if (fd != -1) close(fd);
+            progress.verifying.store(false);
+            progress.failed.store(true);
+            continue;
         }
-    } catch (...) {
+        readers.push_back({progressIndex, fd, nullptr});
+        alignment = std::max<size_t>(alignment, sectorSize);
+    }
+
+    const size_t bufferSize = writeBlockSize(alignment);
+    for (Reader& reader : readers) {
+        if (posix_memalign(reinterpret_cast<void**>(&reader.buffer), alignment, bufferSize) != 0) {
+            reader.buffer = nullptr;
+        }
+    }
+
+    auto compare = [&](size_t i, const char* isoData, uint64_t offset, size_t want) {
+        Reader& reader = readers[i];
+        if (!reader.buffer) {
+            return false;
+        }
+
+        // The device is larger than the image, so its reads can always cover whole aligned blocks
+        const size_t deviceWant = std::min(bufferSize, (want + alignment - 1) / alignment * alignment);
+        size_t got = 0;
+        while (got < want) {
+            ssize_t result = pread(reader.fd, reader.buffer + got, deviceWant - got, static_cast<off_t>(offset + got));
+            if (result == -1 && errno == EINTR) continue;
+            if (result <= 0) return false;
+            got += static_cast<size_t>(result);
+        }
+
+        ProgressInfo& progress = progressData[reader.progressIndex];
+        const size_t mismatch = firstMismatch(isoData, reader.buffer, want);
+        if (mismatch != want) {
+            progress.mismatchOffset.store(static_cast<int64_t>(offset + mismatch));
+            return false;
+        }
+        progress.progress.store(static_cast<int>((static_cast<double>(offset + want) / fileSize) * 100));
+        return true;
+    };
+
+    auto finish = [&](size_t i, bool complete) {
+        ProgressInfo& progress = progressData[readers[i].progressIndex];
+        progress.verifying.store(false);
+        if (g_operationCancelled.load()) {
+            return;
+        }
+        if (!complete) {
+            progress.failed.store(true);
+            return;
+        }
+        progress.verified.store(true);
+    };
+
+    if (!readers.empty()) {
+        shareIsoBlocks(iso, fileSize, alignment, readers.size(), compare, finish);
+    }
+
+    for (Reader& reader : readers) {
+        std::free(reader.buffer);
+        close(reader.fd);
+    }
+}
+
+
+// Function to write ISO to USB device
+bool writeIsoToDevice(const std::string& isoPath, const std::string& device, size_t progressIndex, bool verify) {
+    IsoSource iso;
+    if (!iso.open(isoPath)) {
+        progressData[progressIndex].failed.store(true);
+        return false;
+    }
+
+    // Size the open descriptor rather than the path, which could throw or name a different file by now
+    struct stat isoStat;
+    if (fstat(iso.fd, &isoStat) == -1) {
+        progressData[progressIndex].failed.store(true);
+        return false;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(isoStat.st_size);
+    int sectorSize;
+    int device_fd = openTargetDevice(device, fileSize, sectorSize);
+    if (device_fd == -1) {
+        progressData[progressIndex].failed.store(true);
+        return false;
+    }
+
+    // Four aligned buffers: while one block is written to the stick the next ones are being read
+    const size_t alignment = std::max<size_t>(sectorSize, 4096);
+    AsyncIoQueue queue(4, writeBlockSize(alignment), alignment);
+    if (!queue.valid()) {
+        progressData[progressIndex].failed.store(true);
+        close(device_fd);
+        return false;
+    }
+
+    WriteProgressMeter meter(progressIndex, fileSize);
+    auto updateProgress = [&meter](size_t bytesWritten) {
+        meter.add(bytesWritten);
+    };
+
+    AsyncIoQueue::Stream stream;
+    stream.in = iso.fd;
+    stream.length = fileSize;
+    stream.out = device_fd;
+    stream.readAlignment = iso.direct ? alignment : 0;
+
+    bool written = queue.run(stream, nullptr, updateProgress);
+
+    // Some filesystems accept O_DIRECT at open but refuse the reads, retry those through the cache
+    if (!written && iso.direct && progressData[progressIndex].bytesWritten.load() == 0 && !g_operationCancelled.load()) {
+        iso.useCachedReads();
+        stream.readAlignment = 0;
+        written = queue.run(stream, nullptr, updateProgress);
+    }
+
+    if (!written && !g_operationCancelled.load()) {
+        iso.dropCache();
         progressData[progressIndex].failed.store(true);
         close(device_fd);
         return false;
@@ -777,9 +1137,116 @@ bool writeIsoToDevice(const std::string& isoPath, const std::string& device, siz
     close(device_fd);
 
     if (!g_operationCancelled && progressData[progressIndex].bytesWritten.load() == fileSize) {
+        if (verify) {
+            verifyDevices(iso, fileSize, {{progressIndex, device}});
+        }
+        iso.dropCache();
+        if (verify && !progressData[progressIndex].verified.load()) {
+            return false;
+        }
         progressData[progressIndex].completed.store(true);
         return true;
     }
-    
+
+    iso.dropCache();
     return false;
 }
+
+
+// Function to write one ISO to several devices from a single read of every block. Verification
+// waits until every device is written and then compares them all in one more pass over the ISO.
+void broadcastIsoToDevices(const std::string& isoPath, const std::vector<size_t>& progressIndices, const std::vector<std::string>& devices, bool verify) {
+    struct Target {
+        size_t progressIndex;
+        std::string device;
+        int fd;
+    };
+
+    IsoSource iso;
+    if (!iso.open(isoPath)) {
+        for (size_t index : progressIndices) progressData[index].failed.store(true);
+        return;
+    }
+    struct stat isoStat;
+    if (fstat(iso.fd, &isoStat) == -1) {
+        for (size_t index : progressIndices) progressData[index].failed.store(true);
+        return;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(isoStat.st_size);
+
+    // Devices that cannot take the image drop out before the first read
+    std::vector<Target> targets;
+    size_t alignment = 4096;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        int sectorSize;
+        int fd = openTargetDevice(devices[i], fileSize, sectorSize);
+        if (fd == -1) {
+            progressData[progressIndices[i]].failed.store(true);
+            continue;
+        }
+        targets.push_back({progressIndices[i], devices[i], fd});
+        alignment = std::max<size_t>(alignment, sectorSize);
+    }
+    if (targets.empty()) {
+        return;
+    }
+
+    std::deque<WriteProgressMeter> meters;
+    for (const Target& target : targets) {
+        meters.emplace_back(target.progressIndex, fileSize);
+    }
+
+    auto write = [&](size_t i, const char* data, uint64_t offset, size_t length) {
+        size_t written = 0;
+        while (written < length && !g_operationCancelled.load()) {
+            ssize_t result = pwrite(targets[i].fd, data + written, length - written, static_cast<off_t>(offset + written));
+            if (result == -1 && errno == EINTR) continue;
+            if (result <= 0) return false;
+            written += static_cast<size_t>(result);
+        }
+        meters[i].add(written);
+        return written == length;
+    };
+
+    // Each device syncs on its own, overlapping the writes still running elsewhere
+    std::vector<char> written(targets.size(), 0);
+    auto finish = [&](size_t i, bool complete) {
+        ProgressInfo& progress = progressData[targets[i].progressIndex];
+        if (g_operationCancelled.load()) {
+            return;
+        }
+        if (!complete) {
+            progress.failed.store(true);
+            return;
+        }
+        fsync(targets[i].fd);
+        if (progress.bytesWritten.load() != fileSize) {
+            progress.failed.store(true);
+            return;
+        }
+        written[i] = 1;
+        if (!verify) {
+            progress.completed.store(true);
+        }
+    };
+
+    shareIsoBlocks(iso, fileSize, alignment, targets.size(), write, finish);
+
+    for (const Target& target : targets) {
+        close(target.fd);
+    }
+
+    if (verify && !g_operationCancelled.load()) {
+        std::vector<std::pair<size_t, std::string>> toVerify;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (written[i]) toVerify.emplace_back(targets[i].progressIndex, targets[i].device);
+        }
+        verifyDevices(iso, fileSize, toVerify);
+        for (const auto& [progressIndex, device] : toVerify) {
+            if (progressData[progressIndex].verified.load()) {
+                progressData[progressIndex].completed.store(true);
+            }
+        }
+    }
+    iso.dropCache();
+}
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#ifndef ISOLIST_H
+#define ISOLIST_H
+
+
+// Lowercase shadow of globalIsoFileList, entry i always describes globalIsoFileList[i].
+// Every path is folded once into one arena, so sorting and filtering the ISO list neither
+// folds nor allocates per entry. Guarded by updateListMutex like the list itself.
+class IsoListIndex {
+private:
+    struct Entry {
+        uint64_t sortKey;       // first 8 folded bytes, big endian, zero padded
+        uint32_t offset;        // folded path in arena
+        uint32_t length;
+        uint32_t nameOffset;    // basename, relative to offset
+        uint32_t source;        // record number in the cache file
+    };
+
+    std::string arena;
+    std::vector<Entry> entries;
+    size_t deadBytes = 0;
+
+    // Bumped by every change of the list, views taken before it are stale
+    uint64_t listGeneration = 1;
+
+    // Position of every cache record in the list, valid while sourcesMapped is set
+    std::vector<uint32_t> sourcePositions;
+    bool sourcesMapped = false;
+
+    void rebuildSourcePositions() {
+        std::fill(sourcePositions.begin(), sourcePositions.end(), UINT32_MAX);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].source < sourcePositions.size()) sourcePositions[entries[i].source] = static_cast<uint32_t>(i);
+        }
+    }
+
+    static char foldAscii(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+    }
+
+    // Function to fold a path into the arena and describe it
+    Entry makeEntry(std::string_view path) {
+        Entry entry;
+        entry.offset = static_cast<uint32_t>(arena.size());
+        entry.length = static_cast<uint32_t>(path.size());
+        size_t slash = path.rfind('/');
+        entry.nameOffset = slash == std::string_view::npos ? 0 : static_cast<uint32_t>(slash + 1);
+        entry.source = UINT32_MAX;
+
+        entry.sortKey = 0;
+        for (size_t i = 0; i < path.size(); ++i) {
+            char c = foldAscii(path[i]);
+            arena.push_back(c);
+            if (i < 8) entry.sortKey |= static_cast<uint64_t>(static_cast<unsigned char>(c)) << (56 - 8 * i);
+        }
+        return entry;
+    }
+
+    std::string_view view(const Entry& entry) const {
+        return std::string_view(arena.data() + entry.offset, entry.length);
+    }
+
+    // Same order as strcasecmp, the key settles most comparisons without touching the arena
+    bool less(const Entry& a, const Entry& b) const {
+        if (a.sortKey != b.sortKey) return a.sortKey < b.sortKey;
+        if (a.length <= 8 || b.length <= 8) return a.length < b.length;
+        return view(a).substr(8) < view(b).substr(8);
+    }
+
+    // Function to drop folded bytes of removed entries once they outweigh the live ones
+    void compactArena() {
+        if (deadBytes * 2 < arena.size()) return;
+
+        std::string compacted;
+        compacted.reserve(arena.size() - deadBytes);
+        for (Entry& entry : entries) {
+            uint32_t offset = static_cast<uint32_t>(compacted.size());
+            compacted.append(arena, entry.offset, entry.length);
+            entry.offset = offset;
+        }
+        arena.swap(compacted);
+        deadBytes = 0;
+    }
+
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    size_t size() const { return entries.size(); }
+
+    uint64_t generation() const { return listGeneration; }
+
+    std::string_view folded(size_t i) const { return view(entries[i]); }
+
+    std::string_view foldedName(size_t i) const { return view(entries[i]).substr(entries[i].nameOffset); }
+
+    void clear() {
+        arena.clear();
+        entries.clear();
+        deadBytes = 0;
+        sourcePositions.clear();
+        sourcesMapped = false;
+        ++listGeneration;
+    }
+
+    bool sourcesCurrent() const { return sourcesMapped; }
+
+    // Function to get the list position of a cache record, npos if it is not listed
+    size_t positionOfSource(size_t source) const {
+        if (!sourcesMapped || source >= sourcePositions.size() || sourcePositions[source] == UINT32_MAX) return npos;
+        return sourcePositions[source];
+    }
+
+    // Function to match the list against count cache records after it was patched in place
+    template <typename PathOf>
+    void mapSources(const std::vector<std::string>& paths, size_t count, PathOf&& pathOf) {
+        std::unordered_map<std::string_view, uint32_t> positions;
+        positions.reserve(paths.size());
+        for (size_t i = 0; i < paths.size(); ++i) {
+            entries[i].source = UINT32_MAX;
+            positions.emplace(paths[i], static_cast<uint32_t>(i));
+        }
+        for (size_t source = 0; source < count; ++source) {
+            auto it = positions.find(pathOf(source));
+            if (it != positions.end()) entries[it->second].source = static_cast<uint32_t>(source);
+        }
+        sourcePositions.assign(count, UINT32_MAX);
+        rebuildSourcePositions();
+        sourcesMapped = true;
+    }
+
+    // Function to find the position of path in the sorted list, npos if it is not listed
+    size_t find(const std::vector<std::string>& paths, std::string_view path) const {
+        uint64_t key = 0;
+        for (size_t i = 0; i < path.size() && i < 8; ++i) {
+            key |= static_cast<uint64_t>(static_cast<unsigned char>(foldAscii(path[i]))) << (56 - 8 * i);
+        }
+
+        // Paths differing only in case fold to the same entry, so the whole equal range is checked
+        auto foldedLess = [this](const Entry& entry, std::pair<uint64_t, std::string_view> probe) {
+            if (entry.sortKey != probe.first) return entry.sortKey < probe.first;
+            std::string_view folded = view(entry);
+            size_t common = std::min(folded.size(), probe.second.size());
+            for (size_t i = 8; i < common; ++i) {
+                char c = foldAscii(probe.second[i]);
+                if (folded[i] != c) return static_cast<unsigned char>(folded[i]) < static_cast<unsigned char>(c);
+            }
+            return folded.size() < probe.second.size();
+        };
+
+        auto it = std::lower_bound(entries.begin(), entries.end(), std::make_pair(key, path), foldedLess);
+        auto sameFolded = [this, &path](const Entry& entry) {
+            std::string_view folded = view(entry);
+            if (folded.size() != path.size()) return false;
+            for (size_t i = 0; i < folded.size(); ++i) {
+                if (folded[i] != foldAscii(path[i])) return false;
+            }
+            return true;
+        };
+
+        for (size_t i = static_cast<size_t>(it - entries.begin()); i < entries.size() && sameFolded(entries[i]); ++i) {
+            if (paths[i] == path) return i;
+        }
+        return npos;
+    }
+
+    // Function to rebuild the index for a list freshly loaded in cache file order
+    void assign(const std::vector<std::string>& paths) {
+        clear();
+        size_t total = 0;
+        for (const std::string& path : paths) total += path.size();
+        arena.reserve(total);
+        entries.reserve(paths.size());
+        for (const std::string& path : paths) {
+            entries.push_back(makeEntry(path));
+            entries.back().source = static_cast<uint32_t>(entries.size() - 1);
+        }
+        sourcePositions.resize(paths.size());
+        rebuildSourcePositions();
+        sourcesMapped = true;
+    }
+
+    // Function to sort paths case-insensitively, moving the list and the index together
+    void sort(std::vector<std::string>& paths) {
+        std::vector<uint32_t> order(entries.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return less(entries[a], entries[b]);
+        });
+
+        std::vector<std::string> sortedPaths;
+        std::vector<Entry> sortedEntries;
+        sortedPaths.reserve(paths.size());
+        sortedEntries.reserve(entries.size());
+        for (uint32_t i : order) {
+            sortedPaths.push_back(std::move(paths[i]));
+            sortedEntries.push_back(entries[i]);
+        }
+        paths.swap(sortedPaths);
+        entries.swap(sortedEntries);
+        rebuildSourcePositions();
+        ++listGeneration;
+    }
+
+    // Function to add paths to a sorted list, small batches go straight to their position
+    void insert(std::vector<std::string>& paths, const std::vector<std::string>& added) {
+        sourcesMapped = false;
+        ++listGeneration;
+        if (added.size() > 64) {
+            for (const std::string& path : added) {
+                entries.push_back(makeEntry(path));
+                paths.push_back(path);
+            }
+            sort(paths);
+            return;
+        }
+
+        for (const std::string& path : added) {
+            Entry entry = makeEntry(path);
+            auto it = std::lower_bound(entries.begin(), entries.end(), entry,
+                [this](const Entry& a, const Entry& b) { return less(a, b); });
+            size_t position = static_cast<size_t>(it - entries.begin());
+            entries.insert(it, entry);
+            paths.insert(paths.begin() + position, path);
+        }
+    }
+
+    // Function to remove every path matching the predicate from the list and the index
+    template <typename Pred>
+    void removeIf(std::vector<std::string>& paths, Pred&& pred) {
+        sourcesMapped = false;
+        ++listGeneration;
+        size_t kept = 0;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (pred(paths[i])) {
+                deadBytes += entries[i].length;
+                continue;
+            }
+            if (kept != i) {
+                paths[kept] = std::move(paths[i]);
+                entries[kept] = entries[i];
+            }
+            ++kept;
+        }
+        paths.resize(kept);
+        entries.resize(kept);
+        compactArena();
+    }
+};
+
+
+// Filtered subset of globalIsoFileList as positions in display order, valid while the list is at generation
+struct IsoListView {
+    std::vector<size_t> positions;
+    uint64_t generation = 0;
+};
+
+#endif // ISOLIST_H
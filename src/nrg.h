@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#ifndef NRG_H
+#define NRG_H
+
+
+// Special thanks to the original authors of the conversion tools:
+
+// Salvatore Santagati (mdf2iso).
+// Grégory Kokanosky (nrg2iso).
+// Danny Kurniawan and Kerry Harris (ccd2iso).
+
+// Note: Their original code has been modernized and ported to C++.
+
+// One track of an NRG image as laid out in the file
+struct NrgTrack {
+    uint64_t offset = 0;        // first sector of index 1, pregap excluded
+    uint64_t length = 0;        // bytes of whole sectors
+    size_t sector_size = 0;     // 2048, 2336, 2352 or 2448 with subchannel
+    bool data = true;
+};
+
+
+// Track table read from the chunk list Nero appends after the track data.
+// v1 images end with "NERO" and a 32 bit chunk list offset, v2 images with "NER5" and a 64 bit one.
+struct NrgImageInfo {
+    std::vector<NrgTrack> tracks;
+
+    static uint32_t be32(const unsigned char* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    static uint64_t be64(const unsigned char* p) {
+        return (uint64_t(be32(p)) << 32) | be32(p + 4);
+    }
+
+    // Sector size for a Nero track mode, 0 for modes without ISO payload
+    static size_t sectorSizeOfMode(uint32_t mode) {
+        switch (mode) {
+            case 0x00: case 0x02: return 2048;  // Mode 1, Mode 2 Form 1
+            case 0x03: return 2336;             // Mode 2 without sync and header
+            case 0x05: case 0x06: case 0x07: return 2352;  // Raw Mode 1, raw Mode 2, audio
+            case 0x0f: case 0x10: case 0x11: return 2448;  // Raw Mode 1, audio, raw Mode 2 with subchannel
+            default: return 0;
+        }
+    }
+
+    // Function to tell whether a Nero track mode holds audio rather than data sectors
+    static bool isAudioMode(uint32_t mode) {
+        return mode == 0x07 || mode == 0x10;
+    }
+
+    // Function to add a track unless its extent lies outside the track data
+    void addTrack(uint64_t offset, uint64_t end, size_t sectorSize, bool data, uint64_t dataEnd) {
+        if (sectorSize == 0 || end <= offset || end > dataEnd) {
+            return;
+        }
+
+        // Raw tracks with subchannel keep the nominal 2352 in their descriptor
+        uint64_t length = end - offset;
+        if (sectorSize == 2352 && length % 2352 != 0 && length % 2448 == 0) {
+            sectorSize = 2448;
+        }
+
+        NrgTrack track;
+        track.offset = offset;
+        track.length = length - length % sectorSize;
+        track.sector_size = sectorSize;
+        track.data = data;
+        if (track.length > 0) {
+            tracks.push_back(track);
+        }
+    }
+
+    // Function to walk the chunk list, false if the image carries no usable footer
+    bool parseNrgLayout(std::ifstream& nrgFile) {
+        tracks.clear();
+
+        nrgFile.clear();
+        nrgFile.seekg(0, std::ios::end);
+        const std::streamoff end = nrgFile.tellg();
+        if (end < 12) {
+            return false;
+        }
+        const uint64_t fileSize = static_cast<uint64_t>(end);
+
+        unsigned char tail[12];
+        nrgFile.seekg(end - 12);
+        if (!nrgFile.read(reinterpret_cast<char*>(tail), 12)) {
+            return false;
+        }
+
+        bool v2;
+        uint64_t chunksOffset;
+        if (std::memcmp(tail, "NER5", 4) == 0) {
+            v2 = true;
+            chunksOffset = be64(tail + 4);
+        } else if (std::memcmp(tail + 4, "NERO", 4) == 0) {
+            v2 = false;
+            chunksOffset = be32(tail + 8);
+        } else {
+            return false;
+        }
+
+        // Track data never reaches past the chunk list, a bogus offset is not trusted
+        const uint64_t chunksEnd = fileSize - (v2 ? 12 : 8);
+        if (chunksOffset >= chunksEnd || chunksEnd - chunksOffset > 16 * 1024 * 1024) {
+            return false;
+        }
+
+        std::vector<unsigned char> chunks(static_cast<size_t>(chunksEnd - chunksOffset));
+        nrgFile.seekg(static_cast<std::streamoff>(chunksOffset));
+        if (!nrgFile.read(reinterpret_cast<char*>(chunks.data()), static_cast<std::streamsize>(chunks.size()))) {
+            return false;
+        }
+
+        // Track numbers whose Q control field in CUES/CUEX marks them as audio
+        std::set<unsigned> audioTracks;
+        unsigned nextTrack = 1;
+
+        size_t pos = 0;
+        while (pos + 8 <= chunks.size()) {
+            const unsigned char* id = chunks.data() + pos;
+            const size_t size = be32(id + 4);
+            const unsigned char* body = id + 8;
+            if (std::memcmp(id, "END!", 4) == 0 || size > chunks.size() - pos - 8) {
+                break;
+            }
+
+            if (std::memcmp(id, "CUES", 4) == 0 || std::memcmp(id, "CUEX", 4) == 0) {
+                // 8 byte entries: control/ADR, BCD track, BCD index, then the position
+                for (size_t i = 0; i + 8 <= size; i += 8) {
+                    const unsigned control = body[i] >> 4;
+                    const unsigned track = (body[i + 1] >> 4) * 10 + (body[i + 1] & 0x0f);
+                    if (track >= 1 && track <= 99 && !(control & 0x4)) {
+                        audioTracks.insert(track);
+                    }
+                }
+            } else if (std::memcmp(id, "DAOI", 4) == 0 || std::memcmp(id, "DAOX", 4) == 0) {
+                // 22 byte header with the track range, then one descriptor per track
+                const bool wide = id[3] == 'X';
+                const size_t entrySize = wide ? 42 : 30;
+                if (size >= 22) {
+                    unsigned track = body[20];
+                    for (size_t i = 22; i + entrySize <= size; i += entrySize, ++track) {
+                        const unsigned char* entry = body + i;
+                        const size_t sectorSize = (entry[12] << 8) | entry[13];
+                        const uint32_t mode = entry[14];
+                        const uint64_t start = wide ? be64(entry + 26) : be32(entry + 22);
+                        const uint64_t stop = wide ? be64(entry + 34) : be32(entry + 26);
+                        const bool data = !isAudioMode(mode) && !audioTracks.count(track);
+                        addTrack(start, stop, sectorSize ? sectorSize : sectorSizeOfMode(mode), data, chunksOffset);
+                    }
+                    nextTrack = track;
+                }
+            } else if (std::memcmp(id, "ETNF", 4) == 0 || std::memcmp(id, "ETN2", 4) == 0) {
+                // Track at once images: offset, length, mode and start sector per track
+                const bool wide = id[3] == '2';
+                const size_t entrySize = wide ? 32 : 20;
+                for (size_t i = 0; i + entrySize <= size; i += entrySize, ++nextTrack) {
+                    const unsigned char* entry = body + i;
+                    const uint64_t start = wide ? be64(entry) : be32(entry);
+                    const uint64_t length = wide ? be64(entry + 8) : be32(entry + 4);
+                    const uint32_t mode = wide ? be32(entry + 16) : be32(entry + 8);
+                    const bool data = !isAudioMode(mode) && !audioTracks.count(nextTrack);
+                    addTrack(start, start + length, sectorSizeOfMode(mode), data, chunksOffset);
+                }
+            }
+
+            pos += 8 + size;
+        }
+
+        return !tracks.empty();
+    }
+
+    // Function to pick the track holding the file system, the first data track
+    const NrgTrack* dataTrack() const {
+        for (const NrgTrack& track : tracks) {
+            if (track.data) return &track;
+        }
+        return nullptr;
+    }
+};
+
+#endif // NRG_H
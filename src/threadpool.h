@@ -5,344 +5,852 @@
 #include "headers.h"
 
 
-// A global lock-free threadpool for async tasks with work-stealing scalable from 1 to 192 threads
-template <typename T>
-class LockFreeQueue {
+// A global work-stealing threadpool for async tasks scalable from 1 to 192 threads.
+// Every worker owns a Chase-Lev deque: it pushes and pops its own end (LIFO) while idle
+// workers steal from the other end (FIFO). Tasks from outside the pool go through a shared
+// bounded MPMC ring. Idle workers park on a futex and cost no CPU until work arrives.
+
+
+// Move-only callable with inline storage. Callables up to InlineSize bytes (the mount,
+// copy and walker tasks all fit) are stored in place; larger ones fall back to the heap.
+class Task {
+public:
+    static constexpr size_t InlineSize = 104;
+
+    Task() = default;
+
+    template <class F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& f) {
+        emplace(std::forward<F>(f));
+    }
+
+    Task(Task&& other) noexcept {
+        moveFrom(other);
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        reset();
+    }
+
+    // Construct the callable in place, replacing any previous one
+    template <class F>
+    void emplace(F&& f) {
+        using Fn = std::decay_t<F>;
+        reset();
+        if constexpr (sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<Fn>) {
+            new (storage) Fn(std::forward<F>(f));
+            ops = &inlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage) = new Fn(std::forward<F>(f));
+            ops = &heapOps<Fn>;
+        }
+    }
+
+    void operator()() {
+        ops->invoke(storage);
+    }
+
+    explicit operator bool() const {
+        return ops != nullptr;
+    }
+
+    // Destroy the callable, releasing whatever it captured
+    void reset() {
+        if (ops) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
 private:
-    // Cache line size to avoid false sharing
-    static constexpr size_t CACHE_LINE_SIZE = 64;
+    struct Ops {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
 
-    // Node structure to hold data and next pointer
-    struct Node {
-        T data;
-        std::atomic<Node*> next;
-        std::atomic<uint64_t> timestamp;
-        Node(T value = T()) : data(std::move(value)), next(nullptr), timestamp(0) {}
+    template <class Fn>
+    static constexpr Ops inlineOps = {
+        [](void* p) { (*static_cast<Fn*>(p))(); },
+        [](void* dst, void* src) {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* p) { static_cast<Fn*>(p)->~Fn(); }
     };
 
-    // Structure to align atomic pointers to cache lines
-    struct alignas(CACHE_LINE_SIZE) AlignedAtomicNode {
-        std::atomic<Node*> ptr;
-        AlignedAtomicNode(Node* p = nullptr) : ptr(p) {}
+    template <class Fn>
+    static constexpr Ops heapOps = {
+        [](void* p) { (**static_cast<Fn**>(p))(); },
+        [](void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+        [](void* p) { delete *static_cast<Fn**>(p); }
     };
 
-    size_t pool_size;                          // Size of the node pool
-    std::vector<Node> node_pool;               // Pool of preallocated nodes
-    alignas(CACHE_LINE_SIZE) AlignedAtomicNode head; // Head pointer of the queue
-    alignas(CACHE_LINE_SIZE) AlignedAtomicNode tail; // Tail pointer of the queue
-    std::atomic<size_t> pool_index;            // Index to track allocation in the node pool
+    void moveFrom(Task& other) {
+        if (other.ops) {
+            other.ops->move(storage, other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage[InlineSize];
+    const Ops* ops = nullptr;
+};
+
 
-    // Calculate pool size based on number of threads
-    static size_t calculatePoolSize(size_t num_threads) {
-        return std::min(num_threads * 128, static_cast<size_t>(16384));
+// Queue entry holding a Task. Nodes are recycled through per-thread free lists that
+// trade batches via a shared stash, so steady-state submission does not allocate
+// even when one thread submits and others run the tasks.
+struct TaskNode {
+    Task task;
+    TaskNode* next = nullptr; // Link in the pool's overflow list
+
+    static constexpr size_t BatchSize = 256;
+
+    static TaskNode* acquire() {
+        std::vector<TaskNode*>& local = localNodes().nodes;
+        if (local.empty()) {
+            Stash& stash = sharedStash();
+            std::lock_guard<std::mutex> lock(stash.mutex);
+            size_t take = std::min(BatchSize, stash.nodes.size());
+            local.insert(local.end(), stash.nodes.end() - take, stash.nodes.end());
+            stash.nodes.resize(stash.nodes.size() - take);
+        }
+        if (local.empty()) {
+            return new TaskNode();
+        }
+        TaskNode* node = local.back();
+        local.pop_back();
+        return node;
     }
 
-    // Allocate a new node, either from the pool or dynamically
-    Node* allocate_node(T value) {
-        size_t index = pool_index.fetch_add(1, std::memory_order_relaxed);
-        if (index < pool_size) {
-            Node* node = new (&node_pool[index]) Node(std::move(value));
-            node->timestamp.store(1, std::memory_order_relaxed);
-            return node;
-        } else {
-            Node* node = new Node(std::move(value));
-            node->timestamp.store(1, std::memory_order_relaxed);
-            return node;
+    static void release(TaskNode* node) {
+        node->task.reset();
+        std::vector<TaskNode*>& local = localNodes().nodes;
+        local.push_back(node);
+        if (local.size() >= 2 * BatchSize) {
+            Stash& stash = sharedStash();
+            std::lock_guard<std::mutex> lock(stash.mutex);
+            stash.nodes.insert(stash.nodes.end(), local.end() - BatchSize, local.end());
+            local.resize(local.size() - BatchSize);
         }
     }
 
-    // Deallocate a node, either back to the pool or by deleting
-    void deallocate_node(Node* node) {
-        auto pool_begin = &node_pool[0];
-        auto pool_end = pool_begin + pool_size;
-        if (node >= pool_begin && node < pool_end) {
-            node->~Node();
-            node->timestamp.fetch_add(1, std::memory_order_relaxed);
-        } else {
-            delete node;
+private:
+    struct LocalNodes {
+        std::vector<TaskNode*> nodes;
+        LocalNodes() { nodes.reserve(2 * BatchSize); }
+        ~LocalNodes() {
+            for (TaskNode* node : nodes) delete node;
         }
+    };
+
+    struct Stash {
+        std::mutex mutex;
+        std::vector<TaskNode*> nodes;
+    };
+
+    static LocalNodes& localNodes() {
+        static thread_local LocalNodes nodes;
+        return nodes;
     }
 
-public:
-    // Constructor to initialize the queue with a dummy node
-    explicit LockFreeQueue(size_t num_threads)
-        : pool_size(calculatePoolSize(num_threads)),
-          node_pool(pool_size),
-          head(nullptr),
-          tail(nullptr),
-          pool_index(0)
-    {
-        Node* dummy = allocate_node(T());
-        head.ptr.store(dummy, std::memory_order_relaxed);
-        tail.ptr.store(dummy, std::memory_order_relaxed);
-    }
-
-    // Destructor to clean up the nodes
-    ~LockFreeQueue() {
-        Node* current = head.ptr.load(std::memory_order_acquire);
-        while (current != nullptr) {
-            Node* next = current->next.load(std::memory_order_relaxed);
-            deallocate_node(current);
-            current = next;
-        }
-        for (size_t i = 0; i < pool_size; ++i) {
-            node_pool[i].~Node();
-        }
-    }
-
-    // Enqueue a new item into the queue
-    void enqueue(T value) {
-        Node* new_node = allocate_node(std::move(value));
-        while (true) {
-            Node* old_tail = tail.ptr.load(std::memory_order_acquire);
-            Node* next = old_tail->next.load(std::memory_order_acquire);
-            uint64_t timestamp = old_tail->timestamp.load(std::memory_order_relaxed);
-            if (next == nullptr) {
-                if (old_tail->next.compare_exchange_weak(next, new_node,
-                                                        std::memory_order_release,
-                                                        std::memory_order_relaxed) &&
-                    old_tail->timestamp.compare_exchange_weak(timestamp, timestamp + 1,
-                                                              std::memory_order_release,
-                                                              std::memory_order_relaxed)) {
-                    tail.ptr.compare_exchange_strong(old_tail, new_node,
-                                                     std::memory_order_release,
-                                                     std::memory_order_relaxed);
-                    return;
-                }
-            } else {
-                tail.ptr.compare_exchange_strong(old_tail, next,
-                                                 std::memory_order_release,
-                                                 std::memory_order_relaxed);
-            }
+    // Never destroyed, worker threads may still hand nodes back during exit
+    static Stash& sharedStash() {
+        static Stash* stash = new Stash();
+        return *stash;
+    }
+};
+
+
+// Owner-LIFO / thief-FIFO deque (Chase-Lev, with the C11 orderings of Le et al.)
+template <typename T>
+class WorkStealingDeque {
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Circular buffer, replaced by a larger copy when full
+    struct Array {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Array(int64_t size) : capacity(size), slots(new std::atomic<T>[size]) {}
+
+        T get(int64_t index) const {
+            return slots[index & (capacity - 1)].load(std::memory_order_relaxed);
         }
+
+        void put(int64_t index, T value) {
+            slots[index & (capacity - 1)].store(value, std::memory_order_relaxed);
+        }
+    };
+
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> top{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> bottom{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<Array*> array;
+    std::vector<std::unique_ptr<Array>> arrays; // Current and retired buffers, thieves may still read old ones
+
+    // Double the buffer, only called by the owner
+    Array* grow(Array* current, int64_t b, int64_t t) {
+        auto larger = std::make_unique<Array>(current->capacity * 2);
+        for (int64_t i = t; i < b; ++i) {
+            larger->put(i, current->get(i));
+        }
+        Array* result = larger.get();
+        arrays.push_back(std::move(larger));
+        array.store(result, std::memory_order_release);
+        return result;
     }
 
-    // Dequeue an item from the queue
-    bool dequeue(T& result) {
-        while (true) {
-            Node* old_head = head.ptr.load(std::memory_order_acquire);
-            Node* next = old_head->next.load(std::memory_order_acquire);
-            if (next == nullptr) {
-                return false;
-            }
-            if (head.ptr.compare_exchange_weak(old_head, next,
-                                               std::memory_order_release,
-                                               std::memory_order_relaxed)) {
-                result = std::move(next->data);
-                deallocate_node(old_head);
-                return true;
-            }
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256) {
+        arrays.push_back(std::make_unique<Array>(capacity));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Push onto the owner's end
+    void push(T value) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
         }
+        a->put(b, value);
+        bottom.store(b + 1, std::memory_order_release);
     }
 
-    // Check if the queue is empty
-    bool isEmpty() const {
-        return head.ptr.load(std::memory_order_acquire)->next.load(std::memory_order_acquire) == nullptr;
+    // Pop the most recently pushed item, owner only
+    bool pop(T& result) {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        result = a->get(b);
+        if (t == b) {
+            // Last item, race the thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
     }
 
-    // Steal an item from the queue (same as dequeue)
+    // Take the oldest item, callable from any thread
     bool steal(T& result) {
-        return dequeue(result);
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+
+        Array* a = array.load(std::memory_order_acquire);
+        T value = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        result = value;
+        return true;
     }
 
-    // Enqueue a batch of items into the queue
-    template <typename InputIt>
-    void enqueue_batch(InputIt first, InputIt last) {
-        std::vector<Node*> new_nodes;
-        for (auto it = first; it != last; ++it) {
-            new_nodes.push_back(allocate_node(std::move(*it)));
+    bool isEmpty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+};
+
+
+// Bounded multi-producer multi-consumer ring (Vyukov). Each cell carries a sequence number
+// that tells producers and consumers whose turn it is, so slots are reused in place with no
+// allocation and no ABA window. Capacity must be a power of two; a full ring rejects the push
+// and the caller decides where the item goes instead.
+template <typename T, size_t Capacity>
+class BoundedMpmcQueue {
+private:
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueuePos{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeuePos{0};
+
+public:
+    BoundedMpmcQueue() : cells(new Cell[Capacity]) {
+        for (size_t i = 0; i < Capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
         }
+    }
 
-        if (new_nodes.empty()) return;
+    BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
 
+    // Returns false when the ring is full
+    bool tryEnqueue(T value) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
         while (true) {
-            Node* old_tail = tail.ptr.load(std::memory_order_acquire);
-            Node* next = old_tail->next.load(std::memory_order_acquire);
-            uint64_t timestamp = old_tail->timestamp.load(std::memory_order_relaxed);
-
-            if (next == nullptr) {
-                for (size_t i = 0; i < new_nodes.size() - 1; ++i) {
-                    new_nodes[i]->next.store(new_nodes[i + 1], std::memory_order_relaxed);
+            Cell& cell = cells[pos & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
                 }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
 
-                if (old_tail->next.compare_exchange_weak(next, new_nodes[0],
-                                                         std::memory_order_release,
-                                                         std::memory_order_relaxed) &&
-                    old_tail->timestamp.compare_exchange_weak(timestamp, timestamp + 1,
-                                                              std::memory_order_release,
-                                                              std::memory_order_relaxed)) {
-                    tail.ptr.compare_exchange_strong(old_tail, new_nodes.back(),
-                                                     std::memory_order_release,
-                                                     std::memory_order_relaxed);
-                    return;
+    // Returns false when the ring is empty
+    bool tryDequeue(T& result) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    result = std::move(cell.data);
+                    cell.sequence.store(pos + Capacity, std::memory_order_release);
+                    return true;
                 }
+            } else if (diff < 0) {
+                return false;
             } else {
-                tail.ptr.compare_exchange_strong(old_tail, next,
-                                                 std::memory_order_release,
-                                                 std::memory_order_relaxed);
+                pos = dequeuePos.load(std::memory_order_relaxed);
             }
         }
     }
+};
 
-    // Dequeue a batch of items from the queue
-    template <typename OutputIt>
-    size_t dequeue_batch(OutputIt out, size_t max_items) {
-        size_t dequeued = 0;
-        while (dequeued < max_items) {
-            Node* old_head = head.ptr.load(std::memory_order_acquire);
-            Node* next = old_head->next.load(std::memory_order_acquire);
 
-            if (next == nullptr) {
-                return dequeued;
-            }
+// Queue for tasks submitted from outside the pool. They land in a fixed ring; when a burst
+// fills it they spill into an intrusive list under a mutex instead of blocking the submitter.
+// Spilled tasks may then run after later ring submissions, which no caller relies on.
+class InjectionQueue {
+private:
+    BoundedMpmcQueue<TaskNode*, 1024> ring;
+    std::mutex overflowMutex;
+    TaskNode* overflowHead = nullptr;          // FIFO through TaskNode::next
+    TaskNode* overflowTail = nullptr;
+    std::atomic<size_t> overflowCount{0};
+    std::atomic<size_t> count{0};              // Ring plus overflow, for the parking check
 
-            if (head.ptr.compare_exchange_weak(old_head, next,
-                                               std::memory_order_release,
-                                               std::memory_order_relaxed)) {
-                *out++ = std::move(next->data);
-                deallocate_node(old_head);
-                ++dequeued;
+public:
+    void push(TaskNode* node) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        if (!ring.tryEnqueue(node)) {
+            std::lock_guard<std::mutex> lock(overflowMutex);
+            if (overflowTail) {
+                overflowTail->next = node;
+            } else {
+                overflowHead = node;
             }
+            overflowTail = node;
+            overflowCount.fetch_add(1, std::memory_order_release);
         }
-        return dequeued;
     }
+
+    bool pop(TaskNode*& node) {
+        if (count.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        if (ring.tryDequeue(node)) {
+            count.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (overflowCount.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        if (!overflowHead) {
+            return false;
+        }
+        node = overflowHead;
+        overflowHead = node->next;
+        if (!overflowHead) overflowTail = nullptr;
+        node->next = nullptr;
+        overflowCount.fetch_sub(1, std::memory_order_relaxed);
+        count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool isEmpty() const {
+        return count.load(std::memory_order_seq_cst) == 0;
+    }
+};
+
+
+// Scheduling lanes: interactive tasks are taken before anything else that is queued
+enum class TaskLane {
+    Bulk,
+    Interactive
 };
 
+
+class IoScheduler;
+
+
 class ThreadPool {
 private:
-    // Atomic boolean with cache line alignment to avoid false sharing
-    struct alignas(64) AlignedAtomic {
-        std::atomic<bool> value;
-        AlignedAtomic(bool initial = false) : value(initial) {}
+    // Worker deque padded to its own cache lines
+    struct alignas(64) Worker {
+        WorkStealingDeque<TaskNode*> deque;
     };
 
-    // Atomic size_t with cache line alignment to avoid false sharing
-    struct alignas(64) AlignedAtomicSize {
-        std::atomic<size_t> value;
-        AlignedAtomicSize(size_t initial = 0) : value(initial) {}
+    // Identifies the pool and deque of the current thread, if it is a worker
+    struct WorkerIdentity {
+        ThreadPool* pool = nullptr;
+        size_t index = 0;
     };
 
-    std::vector<std::thread> workers; // Worker threads
-    std::vector<std::unique_ptr<LockFreeQueue<std::function<void()>>>> queues; // Queues for each thread
-    std::mutex mutex; // Mutex for condition variable
-    std::condition_variable cv; // Condition variable for synchronization
-    AlignedAtomic stop; // Atomic flag to stop the thread pool
-    AlignedAtomicSize next_queue; // Index to select next queue for task
-    const size_t num_threads; // Number of threads in the pool
-    std::atomic<size_t> active_tasks; // Counter for active tasks
-    static constexpr size_t BATCH_SIZE = 32; // Batch size for notification
-    std::atomic<size_t> enqueued_tasks{0}; // Counter for enqueued tasks
+    static WorkerIdentity& currentWorker() {
+        static thread_local WorkerIdentity identity;
+        return identity;
+    }
+
+    const size_t num_threads;                  // Number of threads in the pool
+    std::vector<std::unique_ptr<Worker>> workerQueues;
+    std::vector<std::thread> workers;          // Worker threads
+
+    InjectionQueue interactiveQueue;           // Latency lane, checked before any other queue
+    InjectionQueue injectionQueue;             // Bulk tasks submitted from outside the pool
+    std::unique_ptr<IoScheduler> io;           // Per-device limits for I/O tasks
+
+    // Eventcount: parked workers sleep on epoch until a submit bumps it
+    alignas(64) std::atomic<uint32_t> epoch{0};
+    alignas(64) std::atomic<uint32_t> sleepers{0};
+    std::atomic<bool> stop{false};
 
-    // Select a queue to enqueue a new task
-    size_t selectQueue() {
-        static thread_local std::mt19937 rng(std::random_device{}());
-        std::uniform_int_distribution<size_t> dist(0, num_threads - 1);
+    static void futexWait(std::atomic<uint32_t>* address, uint32_t expected) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(address), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    }
+
+    static void futexWake(std::atomic<uint32_t>* address, int count) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(address), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
 
-        size_t base = next_queue.value.fetch_add(1, std::memory_order_relaxed) % num_threads;
-        size_t random_offset = dist(rng) % (num_threads / 4 + 1);
-        return (base + random_offset) % num_threads;
+    // Wake one parked worker if there is any, pairs with the sleepers check in park()
+    void wakeWorker() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) > 0) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            futexWake(&epoch, 1);
+        }
+    }
+
+    // Steal from the other workers, starting at a random victim so thieves spread out
+    bool stealTask(TaskNode*& task, size_t self, uint64_t& seed) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        size_t start = static_cast<size_t>(seed % num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            size_t victim = (start + i) % num_threads;
+            if (victim != self && workerQueues[victim]->deque.steal(task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Interactive work first, then the own deque, outside submissions and the other workers
+    bool findTask(TaskNode*& task, size_t self, uint64_t& seed) {
+        if (interactiveQueue.pop(task)) {
+            return true;
+        }
+        if (self < num_threads && workerQueues[self]->deque.pop(task)) {
+            return true;
+        }
+        return injectionQueue.pop(task) || stealTask(task, self, seed);
+    }
+
+    bool hasQueuedWork() const {
+        if (!interactiveQueue.isEmpty() || !injectionQueue.isEmpty()) {
+            return true;
+        }
+        return std::any_of(workerQueues.begin(), workerQueues.end(),
+                           [](const auto& w) { return !w->deque.isEmpty(); });
+    }
+
+    static void runTask(TaskNode* node) {
+        node->task();
+        TaskNode::release(node);
+    }
+
+    // Sleep until a submit or shutdown; returns at once if work showed up meanwhile
+    void park() {
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t key = epoch.load(std::memory_order_seq_cst);
+        if (!hasQueuedWork() && !stop.load(std::memory_order_acquire)) {
+            futexWait(&epoch, key);
+        }
+        sleepers.fetch_sub(1, std::memory_order_seq_cst);
     }
 
     // Worker thread function
     void workerThread(size_t id) {
-        std::mt19937 rng(id);
-        std::uniform_int_distribution<size_t> dist(0, num_threads - 1);
-        std::exponential_distribution<> exp_dist(1.0);
+        currentWorker() = WorkerIdentity{this, id};
+        uint64_t seed = 0x9E3779B97F4A7C15ull ^ (id + 1);
 
         while (true) {
-            std::function<void()> task;
-            bool got_task = queues[id]->dequeue(task);
-
-            if (!got_task) {
-                size_t steal_attempts = adaptiveStealAttempts();
-                for (size_t i = 0; i < steal_attempts; ++i) {
-                    size_t victim = dist(rng);
-                    if (victim != id && queues[victim]->steal(task)) {
-                        got_task = true;
-                        break;
-                    }
-                    std::this_thread::sleep_for(std::chrono::microseconds(
-                        static_cast<size_t>(exp_dist(rng))));
-                }
+            TaskNode* task = nullptr;
+            if (findTask(task, id, seed)) {
+                runTask(task);
+                continue;
             }
 
-            if (got_task) {
-                ++active_tasks;
-                task();
-                --active_tasks;
-            } else {
-                std::unique_lock<std::mutex> lock(mutex);
-                cv.wait_for(lock, std::chrono::milliseconds(1), [this] {
-                    return stop.value.load(std::memory_order_acquire) ||
-                           std::any_of(queues.begin(), queues.end(),
-                               [](const auto& q) { return !q->isEmpty(); });
-                });
-
-                if (stop.value.load(std::memory_order_acquire) &&
-                    std::all_of(queues.begin(), queues.end(),
-                        [](const auto& q) { return q->isEmpty(); })) {
-                    return;
-                }
+            // Drain before exiting so queued work still runs
+            if (stop.load(std::memory_order_acquire) && !hasQueuedWork()) {
+                return;
             }
+            park();
         }
     }
 
-    // Calculate adaptive steal attempts based on number of threads
-    size_t adaptiveStealAttempts() {
-        if (num_threads <= 2) return 1;
-        return std::min(num_threads / 2, static_cast<size_t>(64));
-    }
-
 public:
     // Constructor to initialize the thread pool
-    explicit ThreadPool(size_t numThreads)
-        : stop(false), next_queue(0), num_threads(numThreads), active_tasks(0) {
-        queues.reserve(numThreads);
-        for (size_t i = 0; i < numThreads; ++i) {
-            queues.emplace_back(std::make_unique<LockFreeQueue<std::function<void()>>>(numThreads));
-        }
-        for (size_t i = 0; i < numThreads; ++i) {
-            workers.emplace_back(&ThreadPool::workerThread, this, i);
-        }
-    }
+    explicit ThreadPool(size_t numThreads);
 
-    // Enqueue a task into the pool and return a future for its result
+    // Destructor runs what is still queued, then joins the threads
+    ~ThreadPool();
+
+    // Enqueue a task into the pool and return a future for its result. The future's shared
+    // state is the only allocation left here; TaskGroup avoids it for bulk submissions.
     template <class F, class... Args>
     auto enqueue(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
         using return_type = decltype(f(args...));
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::packaged_task<return_type()> task(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...)
         );
-        std::future<return_type> res = task->get_future();
+        std::future<return_type> res = task.get_future();
+        submit(std::move(task));
+        return res;
+    }
 
-        size_t index = selectQueue();
-        queues[index]->enqueue([task]() { (*task)(); });
+    // Enqueue a task without a future. Bulk tasks from workers go onto their own deque,
+    // interactive ones always go through the latency lane.
+    template <class F>
+    void submit(F&& f, TaskLane lane = TaskLane::Bulk) {
+        TaskNode* queued = TaskNode::acquire();
+        queued->task.emplace(std::forward<F>(f));
+        WorkerIdentity& self = currentWorker();
+        if (lane == TaskLane::Interactive) {
+            interactiveQueue.push(queued);
+        } else if (self.pool == this) {
+            workerQueues[self.index]->deque.push(queued);
+        } else {
+            injectionQueue.push(queued);
+        }
+        wakeWorker();
+    }
 
-        if (++enqueued_tasks % BATCH_SIZE == 0) {
-            cv.notify_all();
+    IoScheduler& ioScheduler() {
+        return *io;
+    }
+
+    // Run one queued task on the calling thread, returns false if nothing was queued
+    bool runPendingTask() {
+        WorkerIdentity& self = currentWorker();
+        size_t index = self.pool == this ? self.index : num_threads;
+        static thread_local uint64_t seed = 0x2545F4914F6CDD1Dull;
+
+        TaskNode* task = nullptr;
+        if (!findTask(task, index, seed)) {
+            return false;
         }
+        runTask(task);
+        return true;
+    }
 
-        return res;
+    // True when called from one of this process's pool workers
+    static bool onWorkerThread() {
+        return currentWorker().pool != nullptr;
+    }
+
+    size_t size() const {
+        return num_threads;
+    }
+};
+
+
+// Caps how many I/O tasks run per block device at once, so a spinning disk serves one stream
+// instead of seeking between many while fast devices still get the whole pool. Tasks name
+// every device they touch and start only once all of them have room; the rest wait here
+// rather than on a worker, and are released as earlier tasks on those devices finish.
+class IoScheduler {
+private:
+    struct Waiting {
+        std::vector<dev_t> devices;
+        Task task;
+    };
+
+    ThreadPool& pool;
+    std::mutex mutex;
+    std::unordered_map<dev_t, size_t> limits;   // Per-device cap, probed on first use
+    std::unordered_map<dev_t, size_t> inFlight;
+    std::list<Waiting> waiting;
+    size_t running = 0;
+    const size_t maxRunning;                    // One worker always stays free for the latency lane
+
+    // Function to derive a device's cap from sysfs: 1 for rotational disks, the whole pool otherwise
+    size_t probeLimit(dev_t dev) const {
+        const size_t wide = pool.size();
+        if (major(dev) == 0) {
+            return wide; // tmpfs, overlay and other virtual filesystems
+        }
+
+        std::string base = "/sys/dev/block/" + std::to_string(major(dev)) + ":" + std::to_string(minor(dev));
+        for (const char* queue : {"/queue/rotational", "/../queue/rotational"}) {
+            std::ifstream file(base + queue);
+            int rotational = 0;
+            if (file >> rotational) {
+                return rotational ? 1 : wide;
+            }
+        }
+        return wide;
+    }
+
+    size_t limitFor(dev_t dev) {
+        auto it = limits.find(dev);
+        if (it == limits.end()) {
+            it = limits.emplace(dev, probeLimit(dev)).first;
+        }
+        return it->second;
     }
 
-    // Destructor to clean up the threads and queues
-    ~ThreadPool() {
-        stop.value.store(true, std::memory_order_release);
-        cv.notify_all();
+    bool canStart(const std::vector<dev_t>& devices) {
+        if (running >= maxRunning) {
+            return false;
+        }
+        for (dev_t dev : devices) {
+            if (inFlight[dev] >= limitFor(dev)) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-        for (std::thread& worker : workers) {
-            worker.join();
+    void acquire(const std::vector<dev_t>& devices) {
+        ++running;
+        for (dev_t dev : devices) {
+            ++inFlight[dev];
         }
     }
 
-    // Wait for all tasks to complete
-    void waitAllTasksCompleted() {
-        std::unique_lock<std::mutex> lock(mutex);
-        cv.wait(lock, [this] {
-            return active_tasks.load(std::memory_order_acquire) == 0 &&
-                   std::all_of(queues.begin(), queues.end(),
-                               [](const auto& q) { return q->isEmpty(); });
+public:
+    explicit IoScheduler(ThreadPool& threadPool)
+        : pool(threadPool), maxRunning(threadPool.size() > 1 ? threadPool.size() - 1 : 1) {}
+
+    // Function to get how many I/O tasks may run on a device at once
+    size_t deviceLimit(dev_t dev) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return limitFor(dev);
+    }
+
+    // Start the task now if its devices have room, otherwise queue it. The task must call
+    // release() with the same devices when it is done.
+    void schedule(std::vector<dev_t> devices, Task task) {
+        std::sort(devices.begin(), devices.end());
+        devices.erase(std::unique(devices.begin(), devices.end()), devices.end());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!canStart(devices)) {
+                waiting.push_back(Waiting{std::move(devices), std::move(task)});
+                return;
+            }
+            acquire(devices);
+        }
+        pool.submit(std::move(task));
+    }
+
+    // Give the devices back and start every waiting task that now fits, oldest first
+    void release(std::vector<dev_t> devices) {
+        std::sort(devices.begin(), devices.end());
+        devices.erase(std::unique(devices.begin(), devices.end()), devices.end());
+
+        std::vector<Task> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --running;
+            for (dev_t dev : devices) {
+                --inFlight[dev];
+            }
+            for (auto it = waiting.begin(); it != waiting.end();) {
+                if (canStart(it->devices)) {
+                    acquire(it->devices);
+                    ready.push_back(std::move(it->task));
+                    it = waiting.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (Task& task : ready) {
+            pool.submit(std::move(task));
+        }
+    }
+};
+
+
+inline ThreadPool::ThreadPool(size_t numThreads)
+    : num_threads(std::max(numThreads, static_cast<size_t>(1))) {
+    io = std::make_unique<IoScheduler>(*this);
+    workerQueues.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        workerQueues.emplace_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.emplace_back(&ThreadPool::workerThread, this, i);
+    }
+}
+
+
+inline ThreadPool::~ThreadPool() {
+    stop.store(true, std::memory_order_seq_cst);
+    epoch.fetch_add(1, std::memory_order_seq_cst);
+    futexWake(&epoch, INT_MAX);
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+
+// Process-wide pool shared by every subsystem, started on first use with one worker per core.
+// It is never torn down so exit does not wait for background work still queued on it.
+inline ThreadPool& globalThreadPool() {
+    static ThreadPool* pool = new ThreadPool(std::max(maxThreads, 1u));
+    return *pool;
+}
+
+
+// Tasks of one operation on the shared pool, waited for and cancelled together
+class TaskGroup {
+private:
+    ThreadPool& pool;
+    const std::atomic<bool>* cancelFlag;     // External flag that also cancels the group, may be null
+    const TaskLane lane;
+    std::atomic<bool> cancelled{false};
+    std::atomic<size_t> pending{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // The last task signals under the mutex, wait() takes it once more before returning so
+    // the group cannot be destroyed while that signal is still in progress
+    void finishTask() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            cv.notify_all();
+        }
+    }
+
+public:
+    explicit TaskGroup(ThreadPool& threadPool = globalThreadPool(), const std::atomic<bool>* cancelOn = nullptr,
+                       TaskLane taskLane = TaskLane::Bulk)
+        : pool(threadPool), cancelFlag(cancelOn), lane(taskLane) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Tasks may still reference the caller's locals, so the group always drains before it goes away
+    ~TaskGroup() {
+        wait();
+    }
+
+    // Queue a task, it is skipped if the group is cancelled before it starts
+    template <class F>
+    void run(F&& f) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.submit([this, task = std::forward<F>(f)]() mutable {
+            if (!isCancelled()) {
+                // A throwing task must not take the worker down, errors are reported by the tasks themselves
+                try {
+                    task();
+                } catch (...) {
+                }
+            }
+            finishTask();
+        }, lane);
+    }
+
+    // Queue a task that reads or writes the given devices (st_dev of the files involved).
+    // It waits in the pool's IoScheduler until each device is below its concurrency cap.
+    template <class F>
+    void runOnDevices(std::vector<dev_t> devices, F&& f) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        IoScheduler& io = pool.ioScheduler();
+        Task task([this, &io, devices, task = std::forward<F>(f)]() mutable {
+            if (!isCancelled()) {
+                try {
+                    task();
+                } catch (...) {
+                }
+            }
+            io.release(std::move(devices));
+            finishTask();
         });
+        io.schedule(std::move(devices), std::move(task));
+    }
+
+    // Skip every task of the group that has not started yet
+    void cancel() {
+        cancelled.store(true, std::memory_order_release);
+    }
+
+    bool isCancelled() const {
+        return cancelled.load(std::memory_order_acquire) ||
+               (cancelFlag && cancelFlag->load(std::memory_order_acquire));
+    }
+
+    // Wait for every queued task. A pool worker keeps running queued tasks meanwhile,
+    // so nested groups cannot starve the pool.
+    void wait() {
+        const bool helping = ThreadPool::onWorkerThread();
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (helping && pool.runPendingTask()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(helping ? 1 : 100), [this] {
+                return pending.load(std::memory_order_acquire) == 0;
+            });
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
     }
 };
 
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: GNU General Public License v2.0
+
+#ifndef WALKER_H
+#define WALKER_H
+
+
+// Hooks for walkDirectoryTree, every hook may be called from several pool threads at once
+struct DirectoryWalkVisitor {
+    // Called with the open directory before it is read, returning true (and the subdirectory
+    // names in subdirs) skips reading it and descends into those names instead
+    std::function<bool(const std::string& dirPath, int dirFd, const struct stat& dirStat, std::vector<std::string>& subdirs)> reuseDirectory;
+
+    // Called for every regular file, symlinks to regular files included
+    std::function<void(const std::string& dirPath, int dirFd, const char* name)> onFile;
+
+    // Called after a directory was read completely
+    std::function<void(const std::string& dirPath, const struct stat& dirStat, std::vector<std::string>& subdirs, uint64_t fileCount)> onDirectoryRead;
+
+    // Called when a directory cannot be opened or read
+    std::function<void(const std::string& dirPath, int error)> onError;
+};
+
+
+// Image types a single walk sorts files into
+enum class ImageFileType {
+    Other,
+    Iso,
+    BinImg,
+    Mdf,
+    Nrg
+};
+
+
+// Function to classify a file name by its extension, the last four bytes are folded to
+// lowercase and packed into one word so a single switch covers every extension
+inline ImageFileType classifyImageFile(const char* name, size_t length) {
+    if (length < 5) return ImageFileType::Other;
+
+    const unsigned char* suffix = reinterpret_cast<const unsigned char*>(name + length - 4);
+    uint32_t key = 0;
+    for (int i = 0; i < 4; ++i) {
+        unsigned char c = suffix[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        key = (key << 8) | c;
+    }
+
+    constexpr auto pack = [](const char (&ext)[5]) {
+        return (uint32_t(uint8_t(ext[0])) << 24) | (uint32_t(uint8_t(ext[1])) << 16) |
+               (uint32_t(uint8_t(ext[2])) << 8) | uint32_t(uint8_t(ext[3]));
+    };
+
+    switch (key) {
+        case pack(".iso"): return ImageFileType::Iso;
+        case pack(".bin"):
+        case pack(".img"): return ImageFileType::BinImg;
+        case pack(".mdf"): return ImageFileType::Mdf;
+        case pack(".nrg"): return ImageFileType::Nrg;
+        default: return ImageFileType::Other;
+    }
+}
+
+#endif // WALKER_H
@@ -27,6 +27,11 @@ struct ProgressInfo {
     std::atomic<int> progress{0};
     std::atomic<double> speed{0.0};
 
+    // Read-back verification, progress counts the compared share while verifying is set
+    std::atomic<bool> verifying{false};
+    std::atomic<bool> verified{false};
+    std::atomic<int64_t> mismatchOffset{-1};
+
     // Constructor to initialize members
     ProgressInfo(std::string filename, std::string device, std::string totalSize)
         : filename(std::move(filename)),
@@ -42,7 +47,10 @@ struct ProgressInfo {
           failed(other.failed.load()),
           bytesWritten(other.bytesWritten.load()),
           progress(other.progress.load()),
-          speed(other.speed.load()) {}
+          speed(other.speed.load()),
+          verifying(other.verifying.load()),
+          verified(other.verified.load()),
+          mismatchOffset(other.mismatchOffset.load()) {}
 
     // Explicitly define the move assignment operator
     ProgressInfo& operator=(ProgressInfo&& other) noexcept {
@@ -55,6 +63,9 @@ struct ProgressInfo {
             bytesWritten.store(other.bytesWritten.load());
             progress.store(other.progress.load());
             speed.store(other.speed.load());
+            verifying.store(other.verifying.load());
+            verified.store(other.verified.load());
+            mismatchOffset.store(other.mismatchOffset.load());
         }
         return *this;
     }